@@ -0,0 +1,117 @@
+////////////////////////////////////////////////////////////////////
+//
+// AlignmentFileTools.h -- reading the Trans_Alignment_*.dat files,
+// shared by PlotAlignmentVsTimePaper.C and Benchmarks/BenchmarkPLT.C.
+//
+// Each file has two header lines, and then for each scope a line
+// with the channel, -1, and the overall alignment, followed by one
+// line for each of the three ROCs. ROC 0 is the reference, so we
+// save the rotation and x and y translation for ROCs 1 and 2.
+//
+////////////////////////////////////////////////////////////////////
+
+#ifndef ALIGNMENTFILETOOLS_H
+#define ALIGNMENTFILETOOLS_H
+
+#include <iostream>
+#include <map>
+#include <vector>
+#include <cstdio>
+#include <cmath>
+
+// The values for each channel, with one entry per file read.
+struct AlignmentValues {
+  std::map<int, std::vector<double> > rot1;
+  std::map<int, std::vector<double> > rot2;
+  std::map<int, std::vector<double> > transX1;
+  std::map<int, std::vector<double> > transX2;
+  std::map<int, std::vector<double> > transY1;
+  std::map<int, std::vector<double> > transY2;
+};
+
+// Read an alignment file, adding its values to values. Returns the number of scopes read. If verbose is set,
+// print the number of scopes read at the end.
+inline int readAlignmentFile(const char *fileName, AlignmentValues& values, bool verbose = true) {
+  int scopesRead = 0;
+  FILE *afile = fopen(fileName, "r");
+  if (afile == NULL) {
+    std::cerr << "Couldn't open alignment file " << fileName << "!" << std::endl;
+    return 0;
+  }
+  int ichan, iroc;
+  double rXY, rZ, trX, trY, trZ;
+  char dummy[1024];
+
+  // skip header lines
+  fgets(dummy, sizeof(dummy), afile);
+  fgets(dummy, sizeof(dummy), afile);
+
+  while (1) {
+    // scope header line
+    fscanf(afile, "%d %d %lf %lf %lf %lf %lf", &ichan, &iroc, &rZ, &rXY, &trX, &trY, &trZ);
+    if (feof(afile)) {
+      if (verbose) std::cout << "Read in " << scopesRead << " scopes from " << fileName << std::endl;
+      break;
+    }
+    if (iroc != -1) {
+      std::cerr << "Warning: expected -1 for ROC (channel " << ichan << ") and found " << iroc << " instead!" << std::endl;
+      break;
+    }
+    // individual roc lines
+    bool ok = true;
+    for (int i=0; i<3; ++i) {
+      int thischan;
+      fscanf(afile, "%d %d %lf %lf %lf %lf", &thischan, &iroc, &rXY, &trX, &trY, &trZ);
+      if (thischan != ichan) {
+	std::cerr << "Warning: expected " << ichan << " for channel and found " << thischan << " instead!" << std::endl;
+	ok = false;
+	break;
+      }
+      if (iroc != i) {
+	std::cerr << "Warning: expected " << i << " for ROC (channel " << ichan << ") and found " << iroc << " instead!" << std::endl;
+	ok = false;
+	break;
+      }
+      // We found the data! Now save the bits that we want to save.
+      if (i==0) {
+	if (rXY != 0 || trX != 0 || trY != 0 || trZ != 0) {
+	  std::cerr << "Warning: found non-zero alignment values for ROC 0; that shouldn't happen!" << std::endl;
+	}
+      }
+      if (i==1) {
+	values.rot1[ichan].push_back(rXY);
+	values.transX1[ichan].push_back(trX);
+	values.transY1[ichan].push_back(trY);
+	if (fabs(trZ-3.77)>0.0001) {
+	  std::cerr << "Found unexpected z alignment for ROC 1 (expected 3.77, got " << trZ << ")" << std::endl;
+	}
+      }
+      if (i==2) {
+	values.rot2[ichan].push_back(rXY);
+	values.transX2[ichan].push_back(trX);
+	values.transY2[ichan].push_back(trY);
+	if (fabs(trZ-7.54)>0.0001) {
+	  std::cerr << "Found unexpected z alignment for ROC 1 (expected 7.54, got " << trZ << ")" << std::endl;
+	}
+      }
+    } // loop over ROCs
+    if (!ok) break;
+    scopesRead++;
+  }
+
+  fclose(afile);
+  return scopesRead;
+}
+
+// The difference of each value from the average of all of them.
+inline std::vector<double> differencesFromAverage(const std::vector<double>& v) {
+  double sum = 0;
+  for (unsigned int i=0; i<v.size(); ++i)
+    sum += v[i];
+  std::vector<double> diffs(v.size());
+  for (unsigned int i=0; i<v.size(); ++i)
+    diffs[i] = v[i]-sum/v.size();
+  return diffs;
+}
+
+#endif
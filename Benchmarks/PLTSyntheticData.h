@@ -0,0 +1,300 @@
+////////////////////////////////////////////////////////////////////
+//
+// PLTSyntheticData.h -- generators for synthetic, full-size versions
+// of the input files used by the scripts, for benchmarking. The
+// files have the same format as the real ones, so they can be read
+// with the same code:
+// - TrackLumiZC files for a whole fill, either summed over all
+//   bunches or one file per bunch (like TrackLumi_6016_X4_BX/)
+// - per-LS brilcalc CSV output (e.g. for HFOC and PLTZERO)
+// - CombinedRates files
+// - sets of Trans_Alignment_*.dat files
+//
+// The numbers are a simple model of a physics fill (the luminosity
+// decays exponentially, the zero-counting and accidental rates
+// follow from the SBIL, and there's binomial-ish noise), which is
+// enough to make the analysis code do the same work it would on real
+// data, but isn't meant for anything else. Everything is determined
+// by the FillModel, including the random seed, so the same model
+// always gives the same files.
+//
+// This header only needs the standard library (and PLTTimeAlign.h
+// for the timestamp conversion), so it can be used outside of ROOT.
+//
+////////////////////////////////////////////////////////////////////
+
+#ifndef PLTSYNTHETICDATA_H
+#define PLTSYNTHETICDATA_H
+
+#include <string>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <sys/stat.h>
+#include "../Common/PLTTimeAlign.h"
+
+namespace PLTSynthetic {
+
+const int nBunchSlots = 3564;
+const double orbitFrequency = 11245.6;
+
+struct FillModel {
+  int fill;
+  int run;
+  int startTime;         // Unix time of the start of stable beams
+  double hours;          // length of the fill
+  int nBunches;          // number of colliding bunches
+  int nChannels;         // number of PLT channels in the TrackLumiZC files
+  double stepSeconds;    // length of a PLT step
+  double peakSBIL;       // SBIL at the start of the fill, in Hz/ub
+  double lifetimeHours;  // luminosity lifetime
+  double bunchSpread;    // relative RMS of the bunch-by-bunch SBIL
+  double triggerRate;    // PLT trigger rate (all bunch slots), in Hz
+  double sigmaVisPLT;    // mu per unit of SBIL, averaged over channels
+  double accidentalBase; // accidental fraction at zero SBIL
+  double accidentalSlope; // ... and its increase per unit of SBIL
+  int dropoutChannel;    // channel which stops working partway through the fill (-1 for none)
+  double dropoutTime;    // fraction of the fill after which it stops
+  unsigned int seed;
+
+  // Defaults are roughly a long 2018 fill.
+  FillModel(): fill(7000), run(320000), startTime(1530000000), hours(16), nBunches(2544), nChannels(14),
+	       stepSeconds(PLTTimeAlign::lumiSectionLength), peakSBIL(6.0), lifetimeHours(15), bunchSpread(0.1),
+	       triggerRate(3300), sigmaVisPLT(0.0175), accidentalBase(0.08), accidentalSlope(0.015),
+	       dropoutChannel(-1), dropoutTime(0.5), seed(12345) {}
+
+  int nSteps() const { return (int)(hours*3600/stepSeconds); }
+  int nLumiSections() const { return (int)(hours*3600/PLTTimeAlign::lumiSectionLength); }
+  // Average SBIL at t seconds after the start.
+  double sbil(double t) const { return peakSBIL*exp(-t/(lifetimeHours*3600)); }
+  double avgPileup(double sbil) const { return sbil*1e30*80e-27/orbitFrequency; } // 80 mb inelastic xsec
+};
+
+// A luminometer for the brilcalc output: its calibration relative to the truth, its nonlinearity (the
+// relative response changes by this much per unit of SBIL), and its noise.
+struct Luminometer {
+  std::string name;
+  double calibration;
+  double slope;
+  double noise;
+};
+
+inline Luminometer hfoc() { Luminometer l = {"HFOC", 1.0, 0.004, 0.003}; return l; }
+inline Luminometer pltzero() { Luminometer l = {"PLTZERO", 1.0, -0.002, 0.002}; return l; }
+
+// Relative size of each bunch (with mean 1), so that the per-bunch files add up to the summed file.
+inline std::vector<double> bunchScales(const FillModel& model) {
+  std::mt19937 rng(model.seed + 1);
+  std::normal_distribution<double> gaus(1.0, model.bunchSpread);
+  std::vector<double> scales(model.nBunches);
+  double sum = 0;
+  for (int b=0; b<model.nBunches; ++b) {
+    scales[b] = std::max(gaus(rng), 0.1);
+    sum += scales[b];
+  }
+  for (int b=0; b<model.nBunches; ++b)
+    scales[b] *= model.nBunches/sum;
+  return scales;
+}
+
+// The BX numbers of the colliding bunches: trains of 48 with gaps, as far as they fit.
+inline std::vector<int> bunchNumbers(const FillModel& model) {
+  std::vector<int> bx;
+  int b = 1;
+  while ((int)bx.size() < model.nBunches) {
+    bx.push_back(b);
+    b += ((int)bx.size() % 48 == 0 ? 8 : 1);
+    if (b > nBunchSlots) b = b % nBunchSlots + 1;
+  }
+  return bx;
+}
+
+// Relative visible cross section of each channel (mean 1).
+inline std::vector<double> channelScales(const FillModel& model) {
+  std::mt19937 rng(model.seed + 2);
+  std::uniform_real_distribution<double> flat(0.8, 1.2);
+  std::vector<double> scales(model.nChannels);
+  for (int j=0; j<model.nChannels; ++j)
+    scales[j] = flat(rng);
+  return scales;
+}
+
+// Number of successes in n trials with probability p, using a Gaussian approximation for speed.
+inline double binomial(std::mt19937& rng, double n, double p) {
+  std::normal_distribution<double> gaus(0, 1);
+  double x = n*p + gaus(rng)*sqrt(n*p*(1-p));
+  return std::min(std::max(x, 0.0), n);
+}
+
+inline bool makeDirectory(const std::string& dir) {
+  mkdir(dir.c_str(), 0755);
+  struct stat st;
+  return stat(dir.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+// Write one TrackLumiZC file. bunch is the index of the bunch to write, or -1 for the sum over all bunches.
+// Returns the number of steps written, or -1 if the file couldn't be written.
+inline int writeTrackLumiZC(const std::string& fileName, const FillModel& model, int bunch = -1) {
+  FILE *f = fopen(fileName.c_str(), "w");
+  if (!f) return -1;
+  std::mt19937 rng(model.seed + 100 + bunch);
+  const std::vector<double> chScale = channelScales(model);
+  const double bunchScale = (bunch >= 0 ? bunchScales(model)[bunch] : 1.0);
+  const int offset = PLTTimeAlign::dayOffset(model.startTime);
+  const int nSteps = model.nSteps();
+  std::vector<double> channelFull(model.nChannels);
+
+  fprintf(f, "%d %d\n", nSteps, (bunch >= 0 ? 1 : model.nBunches));
+  for (int i=0; i<nSteps; ++i) {
+    double t0 = i*model.stepSeconds, t1 = (i+1)*model.stepSeconds;
+    int tBegin = (int)((model.startTime + t0 - offset)*1000);
+    int tEnd = (int)((model.startTime + t1 - offset)*1000) - 1;
+    double sbil = model.sbil((t0+t1)/2)*bunchScale;
+
+    double nTrig = model.triggerRate*model.stepSeconds;
+    double nFilledTrig = nTrig*model.nBunches/nBunchSlots;
+    if (bunch >= 0) nTrig = nFilledTrig = nTrig/nBunchSlots;
+    int nTrigInt = (int)nTrig, nFilledInt = (int)nFilledTrig;
+
+    double sumFull = 0;
+    for (int j=0; j<model.nChannels; ++j) {
+      bool dead = (j == model.dropoutChannel && i >= model.dropoutTime*nSteps);
+      double mu = model.sigmaVisPLT*chScale[j]*sbil;
+      channelFull[j] = (dead ? 0 : floor(binomial(rng, nFilledInt, 1-exp(-mu))));
+      sumFull += channelFull[j];
+    }
+    double nFull = sumFull/model.nChannels;
+    double accFrac = model.accidentalBase + model.accidentalSlope*sbil;
+    double tracksGood = nFull;
+    double tracksAll = nFull/(1-accFrac);
+
+    fprintf(f, "%d %d %d %f %f %d %f %f   ", tBegin, tEnd, nTrigInt, tracksAll, tracksGood, nFilledInt,
+	    nFilledInt-nFull, nFull);
+    for (int j=0; j<model.nChannels; ++j)
+      fprintf(f, " %d", (int)channelFull[j]);
+    fprintf(f, "\n");
+  }
+  return (fclose(f) == 0 ? nSteps : -1);
+}
+
+// Write one file per bunch, named TrackLumiZC<BX>.txt (with the BX zero-padded to 4 digits) in dir, for the
+// first maxBunches bunches (or all of them if maxBunches < 0). Returns the number of files written.
+inline int writeTrackLumiZCPerBunch(const std::string& dir, const FillModel& model, int maxBunches = -1) {
+  if (!makeDirectory(dir)) return 0;
+  std::vector<int> bx = bunchNumbers(model);
+  int n = (maxBunches < 0 ? model.nBunches : std::min(maxBunches, model.nBunches));
+  int nWritten = 0;
+  for (int b=0; b<n; ++b) {
+    char name[32];
+    snprintf(name, sizeof(name), "/TrackLumiZC%04d.txt", bx[b]);
+    if (writeTrackLumiZC(dir+name, model, b) > 0) ++nWritten;
+  }
+  return nWritten;
+}
+
+// Write the per-LS brilcalc output (brilcalc lumi --byls --output-style csv, in hz/ub) for one luminometer.
+// Returns the number of lumisections written, or -1 if the file couldn't be written.
+inline int writeBrilcalcCSV(const std::string& fileName, const FillModel& model, const Luminometer& lumi) {
+  FILE *f = fopen(fileName.c_str(), "w");
+  if (!f) return -1;
+  std::mt19937 rng(model.seed + 200 + lumi.name.size());
+  std::normal_distribution<double> gaus(0, 1);
+  const int nLS = model.nLumiSections();
+
+  fprintf(f, "#Data tag : synthetic , Norm tag: None\n");
+  fprintf(f, "#run:fill,ls,time,beamstatus,E(GeV),delivered(hz/ub),recorded(hz/ub),avgpu,source\n");
+  double totDelivered = 0, totRecorded = 0;
+  for (int ls=0; ls<nLS; ++ls) {
+    double t = (ls+0.5)*PLTTimeAlign::lumiSectionLength;
+    double sbil = model.sbil(t);
+    double response = lumi.calibration*(1 + lumi.slope*sbil)*(1 + lumi.noise*gaus(rng));
+    double delivered = sbil*model.nBunches*response;
+    double recorded = delivered*0.96;
+    totDelivered += delivered;
+    totRecorded += recorded;
+    fprintf(f, "%d:%d,%d:%d,%d,STABLE BEAMS,6500,%.9f,%.9f,%.1f,%s\n", model.run, model.fill, ls+1, ls+1,
+	    (int)(model.startTime + ls*PLTTimeAlign::lumiSectionLength), delivered, recorded,
+	    model.avgPileup(sbil), lumi.name.c_str());
+  }
+  fprintf(f, "#Summary:\n");
+  fprintf(f, "#nfill,nrun,nls,ncms,totdelivered(hz/ub),totrecorded(hz/ub)\n");
+  fprintf(f, "#1,1,%d,%d,%.9f,%.9f\n", nLS, nLS, totDelivered, totRecorded);
+  return (fclose(f) == 0 ? nLS : -1);
+}
+
+// Write a CombinedRates file for the fill (one line per step). Returns the number of steps written, or -1 if
+// the file couldn't be written.
+inline int writeCombinedRates(const std::string& fileName, const FillModel& model) {
+  FILE *f = fopen(fileName.c_str(), "w");
+  if (!f) return -1;
+  std::mt19937 rng(model.seed + 300);
+  const int offset = PLTTimeAlign::dayOffset(model.startTime);
+  const int nSteps = model.nSteps();
+  const double measSeconds = 1.456; // length of one fast-or measurement
+
+  fprintf(f, "%d %d\n", nSteps, model.nBunches);
+  for (int i=0; i<nSteps; ++i) {
+    double t0 = i*model.stepSeconds, t1 = (i+1)*model.stepSeconds;
+    int tBegin = (int)((model.startTime + t0 - offset)*1000);
+    int tEnd = (int)((model.startTime + t1 - offset)*1000) - 1;
+    double sbil = model.sbil((t0+t1)/2);
+    int nTrig = (int)(model.triggerRate*model.stepSeconds*0.2);
+    int tracksAll = (int)binomial(rng, nTrig, 0.5);
+    double accFrac = model.accidentalBase + model.accidentalSlope*sbil;
+    int tracksGood = (int)binomial(rng, tracksAll, 1-accFrac);
+    int nMeas = (int)(model.stepSeconds/measSeconds);
+    double fastOr = sbil*0.42; // fast-or rate per bunch in the units CombinedRates uses
+    fprintf(f, "%d %d %d %d %d %d %f\n", tBegin, tEnd, nTrig, tracksAll, tracksGood, nMeas,
+	    fastOr*nMeas*model.nBunches);
+  }
+  return (fclose(f) == 0 ? nSteps : -1);
+}
+
+// Write nFiles alignment files Trans_Alignment_<fill>.dat in dir, for consecutive fills starting at
+// firstFill, each with nChannels channels (numbered from 1). The alignment drifts slowly from file to file,
+// with the magnet-off fills (every tenth one) shifted. Returns the number of files written.
+inline int writeAlignmentSet(const std::string& dir, int firstFill, int nFiles, int nChannels = 16,
+			     unsigned int seed = 12345) {
+  if (!makeDirectory(dir)) return 0;
+  std::mt19937 rng(seed + 400);
+  std::normal_distribution<double> gaus(0, 1);
+  // the nominal values for each channel and ROC
+  std::vector<double> rot(nChannels*3), trX(nChannels*3), trY(nChannels*3);
+  for (size_t k=0; k<rot.size(); ++k) {
+    rot[k] = 0.02*gaus(rng);
+    trX[k] = 0.1*gaus(rng);
+    trY[k] = 0.2*gaus(rng);
+  }
+  const double rocZ[3] = {0, 3.77, 7.54};
+
+  int nWritten = 0;
+  for (int n=0; n<nFiles; ++n) {
+    char name[64];
+    snprintf(name, sizeof(name), "/Trans_Alignment_%d.dat", firstFill+n);
+    FILE *f = fopen((dir+name).c_str(), "w");
+    if (!f) continue;
+    double magnetShift = (n % 10 == 0 ? 0.005 : 0);
+    fprintf(f, "#first line:  Channel,-1, Tele.GRZ, Tele.GRY, Tele.GX, Tele.GY, Tele.GZ \n");
+    fprintf(f, "#subsequent lines:  Channel, iroc, C.LR, C.LX, C.LY, C.LZ \n");
+    for (int ch=1; ch<=nChannels; ++ch) {
+      double angle = 3.14159265358979*(2*ch-1)/8;
+      fprintf(f, "\n%2d  -1 %19.6E %18.6E %18.6E %18.6E %18.6E\n", ch, angle, 3.141593,
+	      -4.5*sin(angle), 4.5*cos(angle), (ch <= nChannels/2 ? 171.41 : -171.41));
+      fprintf(f, "%2d   0 %19.6E %18s %18.6E %18.6E %18.6E\n", ch, 0.0, "", 0.0, 0.0, 0.0);
+      for (int roc=1; roc<3; ++roc) {
+	int k = (ch-1)*3 + roc;
+	fprintf(f, "%2d %3d %19.6E %18s %18.6E %18.6E %18.6E\n", ch, roc,
+		rot[k] + 0.0005*gaus(rng), "", trX[k] + magnetShift + 0.001*gaus(rng),
+		trY[k] + magnetShift + 0.001*gaus(rng), rocZ[roc]);
+      }
+    }
+    if (fclose(f) == 0) ++nWritten;
+  }
+  return nWritten;
+}
+
+} // namespace PLTSynthetic
+
+#endif
@@ -0,0 +1,60 @@
+////////////////////////////////////////////////////////////////////
+//
+// PLTAccidentalRates.h -- the per-step accidental rate calculation
+// from a CombinedRates file, shared by the readCombinedFile()
+// functions in PlotAccidentalRatesPaper.C,
+// PlotAccidentalSlopesPaper.C and PlotAccidentalRatesMasks.C, by
+// FitAccidentalsFill.C and ScanMaskGeometries.C (which uses the
+// pieces on scaled counts), and timed by Benchmarks/BenchmarkPLT.C.
+//
+// The accidental rate for each step is the fraction of all tracks
+// which aren't good tracks, in %, with a binomial error; the x value
+// is the fast-or SBIL, i.e. the total fast-or luminosity divided by
+// the number of measurements and the number of bunches.
+//
+////////////////////////////////////////////////////////////////////
+
+#ifndef PLTACCIDENTALRATES_H
+#define PLTACCIDENTALRATES_H
+
+#include <vector>
+#include <cmath>
+#include "PLTStepFile.h"
+
+namespace PLTAccidentalRates {
+
+struct StepRates {
+  std::vector<double> fastOrLumi;
+  std::vector<double> fastOrLumiErr;
+  std::vector<double> accidentalRate;
+  std::vector<double> accidentalRateErr;
+};
+
+// The fast-or SBIL for step i of steps.
+inline double fastOrSBIL(const PLTStepFile::CombinedRatesSteps& steps, int i) {
+  return steps.totLumi[i]/(steps.nMeas[i]*steps.nBunches);
+}
+
+// The accidental rate (in %) and its binomial error for nAcc accidental tracks out of nAll. The counts don't
+// have to be integers, so that this can also be used on counts scaled by an efficiency.
+inline void accidentalRate(double nAcc, double nAll, double& rate, double& rateErr) {
+  double accrate = nAcc/nAll;
+  rate = 100.0*accrate;
+  rateErr = 100.0*sqrt(accrate*(1-accrate)/nAll);
+}
+
+// Compute the SBIL and accidental rate for each step of steps, appending them to rates.
+inline void computeStepRates(const PLTStepFile::CombinedRatesSteps& steps, StepRates& rates) {
+  for (int i=0; i<steps.nSteps; ++i) {
+    rates.fastOrLumi.push_back(fastOrSBIL(steps, i));
+    rates.fastOrLumiErr.push_back(0); // not implemented yet
+    double rate, rateErr;
+    accidentalRate(steps.tracksAll[i]-steps.tracksGood[i], steps.tracksAll[i], rate, rateErr);
+    rates.accidentalRate.push_back(rate);
+    rates.accidentalRateErr.push_back(rateErr);
+  }
+}
+
+} // namespace PLTAccidentalRates
+
+#endif
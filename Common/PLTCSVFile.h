@@ -0,0 +1,318 @@
+////////////////////////////////////////////////////////////////////
+//
+// PLTCSVFile.h -- a shared reader for the CSV files used by the
+// scripts: brilcalc output, the background files from
+// computePLTBackground.py and the vacuum data from Timber, and the
+// CSVs exported from the various spreadsheets.
+//
+// The file is memory-mapped and split into lines and fields in
+// place, without making a string for each field, and the numbers are
+// parsed directly from the mapped file with std::from_chars into one
+// typed vector per column. Which fields to read, and which lines to
+// skip, is described by a Schema; the schemas for the files we use
+// are at the bottom, so each kind of file is only described once.
+//
+// To use:
+//   PLTCSV::Table t;
+//   if (!PLTCSV::read("hfoc_5109.csv", PLTCSV::brilcalcSchema(), t)) { ...error... }
+//   for (size_t i=0; i<t.nRows; ++i) { ... t.ints(0)[i] ... t.floats(1)[i] ... }
+// The columns are numbered in the order they appear in the schema.
+//
+////////////////////////////////////////////////////////////////////
+
+#ifndef PLTCSVFILE_H
+#define PLTCSVFILE_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <charconv>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace PLTCSV {
+
+enum ColumnType { kDouble, kFloat, kInt };
+
+struct ColumnSpec {
+  int field;              // index of the field in the line
+  ColumnType type;
+};
+
+struct Schema {
+  char delimiter;
+  int nFields;            // if > 0, lines without exactly this many fields are reported and skipped
+  int skipLines;          // number of header lines to skip at the start of the file
+  std::string skipPrefixes; // lines starting with any of these characters are skipped
+  bool trackMissing;      // record which fields are empty (see Table::present)
+  std::vector<ColumnSpec> columns;
+
+  Schema(): delimiter(','), nFields(-1), skipLines(0), skipPrefixes("#"), trackMissing(false) {}
+  Schema& column(int field, ColumnType type = kDouble) {
+    ColumnSpec c = {field, type};
+    columns.push_back(c);
+    return *this;
+  }
+};
+
+// The values read. Each column is stored in the vector for its type; an empty or unparseable field is stored
+// as 0 (as reading it with a stringstream did). If the schema has trackMissing set, present(i)[row] says
+// whether field was actually there.
+struct Table {
+  size_t nRows;
+  std::vector<ColumnType> types;
+  std::vector<std::vector<double> > doubleColumns;
+  std::vector<std::vector<float> > floatColumns;
+  std::vector<std::vector<int> > intColumns;
+  std::vector<std::vector<unsigned char> > presentColumns;
+
+  const std::vector<double>& doubles(int i) const { return doubleColumns[i]; }
+  const std::vector<float>& floats(int i) const { return floatColumns[i]; }
+  const std::vector<int>& ints(int i) const { return intColumns[i]; }
+  const std::vector<unsigned char>& present(int i) const { return presentColumns[i]; }
+  // Any column as doubles.
+  double value(int i, size_t row) const {
+    if (types[i] == kInt) return intColumns[i][row];
+    if (types[i] == kFloat) return floatColumns[i][row];
+    return doubleColumns[i][row];
+  }
+};
+
+// Parse a number from [begin, end), skipping leading whitespace (and a leading +, which from_chars doesn't
+// accept). Returns false if there's no number there. "nan" and "inf" don't count as numbers, since reading
+// them with a stringstream didn't work either.
+template <typename T> inline bool parseNumber(const char *begin, const char *end, T& value) {
+  while (begin < end && (*begin == ' ' || *begin == '\t')) ++begin;
+  if (begin < end && *begin == '+') ++begin;
+  const char *digits = (begin < end && *begin == '-' ? begin+1 : begin);
+  if (digits == end || !((*digits >= '0' && *digits <= '9') || *digits == '.')) return false;
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+  return std::from_chars(begin, end, value).ec == std::errc();
+#else
+  // No floating-point from_chars in this library, so use strtod on a copy (the field isn't null-terminated).
+  char buf[64];
+  size_t len = std::min<size_t>(end-begin, sizeof(buf)-1);
+  memcpy(buf, begin, len);
+  buf[len] = '\0';
+  char *parseEnd;
+  double v = strtod(buf, &parseEnd);
+  if (parseEnd == buf) return false;
+  value = (T)v;
+  return true;
+#endif
+}
+template <> inline bool parseNumber<int>(const char *begin, const char *end, int& value) {
+  while (begin < end && (*begin == ' ' || *begin == '\t')) ++begin;
+  if (begin < end && *begin == '+') ++begin;
+  return begin < end && std::from_chars(begin, end, value).ec == std::errc();
+}
+
+// A read-only view of a whole file, memory-mapped if possible.
+class MappedFile {
+public:
+  MappedFile(): mapped(NULL), mappedSize(0) {}
+  ~MappedFile() { if (mapped) munmap((void*)mapped, mappedSize); }
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  // Returns false if the file can't be opened or read.
+  bool open(const std::string& fileName) {
+    int fd = ::open(fileName.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+      close(fd);
+      return false;
+    }
+    mappedSize = st.st_size;
+    if (mappedSize > 0) {
+      void *m = mmap(NULL, mappedSize, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (m != MAP_FAILED) {
+	mapped = (const char*)m;
+	madvise(m, mappedSize, MADV_SEQUENTIAL);
+      } else {
+	// Fall back to reading it. read() can return less than asked for, so keep going until the end.
+	buffer.resize(mappedSize);
+	size_t nRead = 0;
+	while (nRead < buffer.size()) {
+	  ssize_t n = ::read(fd, &buffer[nRead], buffer.size()-nRead);
+	  if (n < 0 && errno == EINTR) continue;
+	  if (n <= 0) {
+	    // An error, or the file got shorter while we were reading it.
+	    buffer.clear();
+	    mappedSize = 0;
+	    close(fd);
+	    return false;
+	  }
+	  nRead += n;
+	}
+	mappedSize = 0;
+      }
+    }
+    close(fd);
+    return true;
+  }
+  const char *begin() const { return mapped ? mapped : buffer.data(); }
+  const char *end() const { return begin() + (mapped ? mappedSize : buffer.size()); }
+
+private:
+  const char *mapped;
+  size_t mappedSize;
+  std::vector<char> buffer;
+};
+
+// Set up table to hold the columns of schema, with no rows.
+inline void initTable(const Schema& schema, Table& table) {
+  const size_t nColumns = schema.columns.size();
+  table.nRows = 0;
+  table.types.resize(nColumns);
+  table.doubleColumns.assign(nColumns, std::vector<double>());
+  table.floatColumns.assign(nColumns, std::vector<float>());
+  table.intColumns.assign(nColumns, std::vector<int>());
+  table.presentColumns.assign(nColumns, std::vector<unsigned char>());
+  for (size_t c=0; c<nColumns; ++c)
+    table.types[c] = schema.columns[c].type;
+}
+
+// Parse the line [lineBegin, lineEnd) (without the newline) and add it to table, which must have been set up
+// with initTable(). Returns false if the line was skipped. fieldStart is just scratch space, so that it can be
+// reused from one line to the next.
+inline bool appendLine(const char *lineBegin, const char *lineEnd, const Schema& schema, Table& table,
+		       std::vector<const char*>& fieldStart) {
+  if (lineEnd > lineBegin && lineEnd[-1] == '\r') --lineEnd;
+  if (lineBegin == lineEnd) return false; // skip blank lines
+  if (schema.skipPrefixes.find(*lineBegin) != std::string::npos) return false; // skip comment/header lines
+
+  // Break into fields
+  fieldStart.clear();
+  fieldStart.push_back(lineBegin);
+  for (const char *q = lineBegin; q < lineEnd; ++q)
+    if (*q == schema.delimiter) fieldStart.push_back(q+1);
+  const int nFields = fieldStart.size();
+  fieldStart.push_back(lineEnd+1);
+
+  if (schema.nFields > 0 && nFields != schema.nFields) {
+    std::cout << "Malformed line in csv file: " << std::string(lineBegin, lineEnd) << std::endl;
+    return false;
+  }
+
+  for (size_t c=0; c<schema.columns.size(); ++c) {
+    const int f = schema.columns[c].field;
+    const char *fb = (f < nFields ? fieldStart[f] : lineEnd);
+    const char *fe = (f < nFields ? fieldStart[f+1]-1 : lineEnd);
+    bool ok;
+    switch (schema.columns[c].type) {
+    case kInt: {
+      int v = 0;
+      ok = parseNumber(fb, fe, v);
+      table.intColumns[c].push_back(ok ? v : 0);
+      break;
+    }
+    case kFloat: {
+      float v = 0;
+      ok = parseNumber(fb, fe, v);
+      table.floatColumns[c].push_back(ok ? v : 0);
+      break;
+    }
+    default: {
+      double v = 0;
+      ok = parseNumber(fb, fe, v);
+      table.doubleColumns[c].push_back(ok ? v : 0);
+      break;
+    }
+    }
+    if (schema.trackMissing) table.presentColumns[c].push_back(fe > fb);
+  }
+  ++table.nRows;
+  return true;
+}
+
+// Read fileName according to schema into table. Returns false (and prints an error) if the file can't be read.
+inline bool read(const std::string& fileName, const Schema& schema, Table& table) {
+  initTable(schema, table);
+  MappedFile file;
+  if (!file.open(fileName)) {
+    std::cerr << "ERROR: cannot read csv file: " << fileName << std::endl;
+    return false;
+  }
+  const char *p = file.begin(), *fileEnd = file.end();
+  // skip a UTF-8 byte order mark, which the spreadsheet exports sometimes have
+  if (fileEnd-p >= 3 && memcmp(p, "\xef\xbb\xbf", 3) == 0) p += 3;
+
+  std::vector<const char*> fieldStart;
+  int lineNumber = 0;
+  while (p < fileEnd) {
+    const char *lineEnd = (const char*)memchr(p, '\n', fileEnd-p);
+    if (!lineEnd) lineEnd = fileEnd;
+    if (lineNumber++ >= schema.skipLines)
+      appendLine(p, lineEnd, schema, table, fieldStart);
+    p = lineEnd + 1;
+  }
+  return true;
+}
+
+//// The schemas for the files we use.
+
+// brilcalc --output-style csv: run:fill, ls, time, beamstatus, E(GeV), delivered, recorded, avgpu, source.
+// Columns: 0 = time (int), 1 = delivered (float, in Hz/ub).
+inline Schema brilcalcSchema() {
+  Schema s;
+  s.nFields = 9;
+  s.column(2, kInt).column(5, kFloat);
+  return s;
+}
+
+// The background files from computePLTBackground.py: time_sec, time_ms, run, ls, nb, and then nValues values.
+// Columns: 0 = time_sec (int), 1 = time_ms (int), 2... = the values.
+inline Schema backgroundSchema(int nValues) {
+  Schema s;
+  s.nFields = 5+nValues;
+  s.column(0, kInt).column(1, kInt);
+  for (int i=0; i<nValues; ++i)
+    s.column(5+i);
+  return s;
+}
+
+// The vacuum data exported from Timber: a header line, then the timestamp and one field for each of the
+// nGauges gauges, which is empty if that gauge has no reading at that time. Columns: 0 = timestamp,
+// 1... = the pressures, with Table::present saying which are there.
+inline Schema vacuumSchema(int nGauges) {
+  Schema s;
+  s.nFields = nGauges+1;
+  s.skipLines = 1;
+  s.trackMissing = true;
+  for (int i=0; i<=nGauges; ++i)
+    s.column(i);
+  return s;
+}
+
+// The PLT/RAMSES ratio and slope CSVs from the spreadsheet (and the 2017 FOM CSV, which has the same layout):
+// fill, nbx, lumi, iLumi, run, ... Columns: 0 = iLumi, 1 = field targetField, and 2 = the following field, if
+// hasError is set. Not every row has every value filled in, so Table::present is set too.
+inline Schema spreadsheetSchema(int targetField, bool hasError) {
+  Schema s;
+  s.skipPrefixes = "F"; // header line
+  s.trackMissing = true;
+  s.column(3).column(targetField);
+  if (hasError) s.column(targetField+1);
+  return s;
+}
+
+// The emittance scan slope fit CSVs: scan, type, BCID, xsec, xsecErr, SBIL, SBILErr, leading. Columns:
+// 0 = xsec, 1 = xsecErr, 2 = SBIL, 3 = SBILErr, 4 = leading (int).
+inline Schema slopeFitSchema() {
+  Schema s;
+  s.skipPrefixes = "X"; // header line
+  s.column(3).column(4).column(5).column(6).column(7, kInt);
+  return s;
+}
+
+} // namespace PLTCSV
+
+#endif
@@ -0,0 +1,442 @@
+////////////////////////////////////////////////////////////////////
+//
+// PLTStepFile.h -- a shared reader for the PLT step files, i.e. the
+// TrackLumiZC_*.txt files used by the track luminosity scripts and
+// the CombinedRates_*.txt files used by the accidental rate scripts.
+//
+// The first time a text file is read, it is converted to a binary
+// file with the same name plus ".pltbin" in which each column is
+// stored as a contiguous array. Subsequent reads just memory-map that
+// file, so nothing has to be parsed. The binary file records the
+// size and modification time of the text file, so if the text file
+// changes, it is automatically regenerated. If the binary file can't
+// be written (e.g. a read-only directory), the converted data is
+// simply kept in memory.
+//
+// To use:
+//   PLTStepFile::StepFile f;
+//   if (!f.open("TrackLumiData/TrackLumiZC_5109.txt", PLTStepFile::kTrackLumiZC, 13)) { ...error... }
+//   const PLTStepFile::TrackLumiZCSteps& s = f.trackLumiZC();
+//   for (int i=0; i<s.nSteps; ++i) { ... s.tBegin[i] ... s.channel(j)[i] ... }
+// A file which is still being written can instead be read a line at a time with parseHeaderLine() and
+// parseTrackLumiZCLine().
+//
+////////////////////////////////////////////////////////////////////
+
+#ifndef PLTSTEPFILE_H
+#define PLTSTEPFILE_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace PLTStepFile {
+
+enum Format { kTrackLumiZC = 1, kCombinedRates = 2 };
+
+// The contents of a TrackLumiZC file: one entry per step in each column. The per-channel track counts are
+// stored channel by channel, so channel(j) is a contiguous array of nSteps values.
+struct TrackLumiZCSteps {
+  int nSteps, nBunches, nChannels;
+  const int32_t *tBegin, *tEnd, *nTrig;
+  const float *tracksAll, *tracksGood;
+  const int32_t *nFilledTrig;
+  const float *nEmpty, *nFull;
+  const int32_t *channelTracks;
+  const int32_t *channel(int j) const { return channelTracks + (size_t)j*nSteps; }
+};
+
+// The contents of a CombinedRates file.
+struct CombinedRatesSteps {
+  int nSteps, nBunches;
+  const int32_t *tBegin, *tEnd, *nTrig, *tracksAll, *tracksGood, *nMeas;
+  const double *totLumi;
+};
+
+const char cacheMagic[8] = {'P', 'L', 'T', 'S', 'T', 'E', 'P', '\0'};
+const uint32_t cacheVersion = 2;
+const char *const cacheSuffix = ".pltbin";
+const int maxColumns = 16;
+const size_t columnAlignment = 64;
+
+// Header at the start of the binary file. The column offsets are in bytes from the start of the file.
+struct CacheHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t format;
+  int64_t sourceSize;
+  int64_t sourceMtimeSec;
+  int64_t sourceMtimeNsec;
+  int32_t nSteps, nBunches, nChannels, nColumns;
+  uint64_t columnOffset[maxColumns];
+};
+
+// Size of one entry in each column, in the order they're stored. The last TrackLumiZC column is the
+// per-channel block, which has nChannels entries per step.
+inline std::vector<size_t> columnSizes(Format format) {
+  if (format == kTrackLumiZC)
+    return {sizeof(int32_t), sizeof(int32_t), sizeof(int32_t), sizeof(float), sizeof(float),
+	sizeof(int32_t), sizeof(float), sizeof(float), sizeof(int32_t)};
+  return {sizeof(int32_t), sizeof(int32_t), sizeof(int32_t), sizeof(int32_t), sizeof(int32_t),
+      sizeof(int32_t), sizeof(double)};
+}
+
+// Parse the number at p and advance p past it. Returns false (leaving value alone) if there isn't one there.
+// These are also used by parseTrackLumiZCLine(), so the files are parsed the same way whichever is used.
+inline bool parseValue(const char *&p, int32_t& value) {
+  char *next;
+  int32_t v = strtol(p, &next, 10);
+  if (next == p) return false;
+  value = v;
+  p = next;
+  return true;
+}
+inline bool parseValue(const char *&p, float& value) {
+  char *next;
+  float v = strtof(p, &next);
+  if (next == p) return false;
+  value = v;
+  p = next;
+  return true;
+}
+inline bool parseValue(const char *&p, double& value) {
+  char *next;
+  double v = strtod(p, &next);
+  if (next == p) return false;
+  value = v;
+  p = next;
+  return true;
+}
+
+// One step of a TrackLumiZC file.
+struct TrackLumiZCStep {
+  int32_t tBegin, tEnd, nTrig;
+  float tracksAll, tracksGood;
+  int32_t nFilledTrig;
+  float nEmpty, nFull;
+  std::vector<int32_t> channelTracks;
+};
+
+// Parse the header line of a step file. Returns false if it doesn't have both numbers.
+inline bool parseHeaderLine(const std::string& line, int32_t& nSteps, int32_t& nBunches) {
+  const char *p = line.c_str();
+  return parseValue(p, nSteps) && parseValue(p, nBunches);
+}
+
+// Parse one step line of a TrackLumiZC file with nChannels per-channel columns, for code which reads the file
+// a line at a time while it's still being written (rather than all at once with StepFile). Returns false if
+// the line doesn't have all of the fields.
+inline bool parseTrackLumiZCLine(const std::string& line, int nChannels, TrackLumiZCStep& step) {
+  const char *p = line.c_str();
+  bool ok = (parseValue(p, step.tBegin) && parseValue(p, step.tEnd) && parseValue(p, step.nTrig) &&
+	     parseValue(p, step.tracksAll) && parseValue(p, step.tracksGood) && parseValue(p, step.nFilledTrig) &&
+	     parseValue(p, step.nEmpty) && parseValue(p, step.nFull));
+  step.channelTracks.resize(nChannels);
+  for (int j=0; j<nChannels && ok; ++j)
+    ok = parseValue(p, step.channelTracks[j]);
+  return ok;
+}
+
+class StepFile {
+public:
+  StepFile(): mapped(NULL), mappedSize(0) { clear(); }
+  ~StepFile() { release(); }
+  StepFile(const StepFile&) = delete;
+  StepFile& operator=(const StepFile&) = delete;
+
+  // Open the text file fileName. For TrackLumiZC files, nChannels is the number of per-channel columns; if -1,
+  // it is taken from the number of fields on the first step line. Returns false (and prints an error) if the
+  // file couldn't be read.
+  bool open(const std::string& fileName, Format format, int nChannels = -1) {
+    release();
+    struct stat sourceStat;
+    if (stat(fileName.c_str(), &sourceStat) != 0) {
+      std::cerr << "Couldn't open step file " << fileName << "!" << std::endl;
+      return false;
+    }
+    std::string cacheName = fileName + cacheSuffix;
+    if (mapCache(cacheName, format, nChannels, sourceStat)) return true;
+
+    // No usable cache, so convert the text file.
+    if (!convert(fileName, format, nChannels, sourceStat)) return false;
+    writeCache(cacheName);
+    return true;
+  }
+
+  const TrackLumiZCSteps& trackLumiZC() const { return zc; }
+  const CombinedRatesSteps& combinedRates() const { return cr; }
+  int nSteps() const { return header().nSteps; }
+  int nBunches() const { return header().nBunches; }
+
+private:
+  const char *mapped;    // the memory-mapped binary file, if we're using it
+  size_t mappedSize;
+  std::vector<char> buffer; // the converted data, if we're not
+  TrackLumiZCSteps zc;
+  CombinedRatesSteps cr;
+
+  const char *data() const { return mapped ? mapped : buffer.data(); }
+  const CacheHeader& header() const { return *(const CacheHeader*)data(); }
+
+  void clear() {
+    memset(&zc, 0, sizeof(zc));
+    memset(&cr, 0, sizeof(cr));
+    buffer.assign(sizeof(CacheHeader), 0);
+  }
+
+  void release() {
+    if (mapped) munmap((void*)mapped, mappedSize);
+    mapped = NULL;
+    mappedSize = 0;
+    clear();
+  }
+
+  static int64_t mtimeNsec(const struct stat& st) {
+#ifdef __APPLE__
+    return st.st_mtimespec.tv_nsec;
+#else
+    return st.st_mtim.tv_nsec;
+#endif
+  }
+
+  // Point the column views at the data (either mapped or in the buffer).
+  void setViews() {
+    const CacheHeader& h = header();
+    const char *d = data();
+    if (h.format == kTrackLumiZC) {
+      zc.nSteps = h.nSteps;
+      zc.nBunches = h.nBunches;
+      zc.nChannels = h.nChannels;
+      zc.tBegin = (const int32_t*)(d + h.columnOffset[0]);
+      zc.tEnd = (const int32_t*)(d + h.columnOffset[1]);
+      zc.nTrig = (const int32_t*)(d + h.columnOffset[2]);
+      zc.tracksAll = (const float*)(d + h.columnOffset[3]);
+      zc.tracksGood = (const float*)(d + h.columnOffset[4]);
+      zc.nFilledTrig = (const int32_t*)(d + h.columnOffset[5]);
+      zc.nEmpty = (const float*)(d + h.columnOffset[6]);
+      zc.nFull = (const float*)(d + h.columnOffset[7]);
+      zc.channelTracks = (const int32_t*)(d + h.columnOffset[8]);
+    } else {
+      cr.nSteps = h.nSteps;
+      cr.nBunches = h.nBunches;
+      cr.tBegin = (const int32_t*)(d + h.columnOffset[0]);
+      cr.tEnd = (const int32_t*)(d + h.columnOffset[1]);
+      cr.nTrig = (const int32_t*)(d + h.columnOffset[2]);
+      cr.tracksAll = (const int32_t*)(d + h.columnOffset[3]);
+      cr.tracksGood = (const int32_t*)(d + h.columnOffset[4]);
+      cr.nMeas = (const int32_t*)(d + h.columnOffset[5]);
+      cr.totLumi = (const double*)(d + h.columnOffset[6]);
+    }
+  }
+
+  // Try to map an existing binary file. Returns false if it doesn't exist or is out of date.
+  bool mapCache(const std::string& cacheName, Format format, int nChannels, const struct stat& sourceStat) {
+    int fd = ::open(cacheName.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat cacheStat;
+    if (fstat(fd, &cacheStat) != 0 || (size_t)cacheStat.st_size < sizeof(CacheHeader)) {
+      close(fd);
+      return false;
+    }
+    void *m = mmap(NULL, cacheStat.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (m == MAP_FAILED) return false;
+
+    const CacheHeader& h = *(const CacheHeader*)m;
+    bool ok = (memcmp(h.magic, cacheMagic, sizeof(cacheMagic)) == 0 && h.version == cacheVersion &&
+	       h.format == (uint32_t)format && h.sourceSize == (int64_t)sourceStat.st_size &&
+	       h.sourceMtimeSec == (int64_t)sourceStat.st_mtime && h.sourceMtimeNsec == mtimeNsec(sourceStat) &&
+	       (nChannels < 0 || h.nChannels == nChannels) && h.nColumns <= maxColumns);
+    // Make sure the file is actually as long as the header says it should be.
+    if (ok) {
+      std::vector<size_t> sizes = columnSizes(format);
+      size_t last = sizes.size()-1;
+      size_t lastEntries = (size_t)h.nSteps * (format == kTrackLumiZC ? h.nChannels : 1);
+      ok = (h.nColumns == (int32_t)sizes.size() &&
+	    h.columnOffset[last] + lastEntries*sizes[last] <= (uint64_t)cacheStat.st_size);
+    }
+    if (!ok) {
+      munmap(m, cacheStat.st_size);
+      return false;
+    }
+    mapped = (const char*)m;
+    mappedSize = cacheStat.st_size;
+    setViews();
+    return true;
+  }
+
+  // Skip whitespace and comment lines (lines starting with #). Returns false if we hit the end.
+  static bool skipToToken(const char *&p, const char *end, bool& newLine) {
+    while (p < end) {
+      if (*p == '\n') {
+	newLine = true;
+	++p;
+      } else if (*p == ' ' || *p == '\t' || *p == '\r') {
+	++p;
+      } else if (*p == '#' && newLine) {
+	while (p < end && *p != '\n') ++p;
+      } else {
+	return true;
+      }
+    }
+    return false;
+  }
+
+  // Number of fields remaining on the current line, starting at p.
+  static int fieldsOnLine(const char *p, const char *end) {
+    int n = 0;
+    bool inField = false;
+    for (; p < end && *p != '\n'; ++p) {
+      bool space = (*p == ' ' || *p == '\t' || *p == '\r');
+      if (!space && !inField) ++n;
+      inField = !space;
+    }
+    return n;
+  }
+
+  // Read the next field and append it to column. Once we run out of fields (exhausted), the last value in the
+  // column is appended instead.
+  template <typename T> static void readField(const char *&p, const char *end, bool& newLine, bool& exhausted,
+					      std::vector<T>& column) {
+    T value = column.empty() ? 0 : column.back();
+    if (!exhausted) {
+      if (skipToToken(p, end, newLine) && parseValue(p, value))
+	newLine = false;
+      else
+	exhausted = true;
+    }
+    column.push_back(value);
+  }
+
+  // Parse the text file into the in-memory buffer, using the same layout as the binary file.
+  bool convert(const std::string& fileName, Format format, int nChannels, const struct stat& sourceStat) {
+    FILE *rfile = fopen(fileName.c_str(), "r");
+    if (rfile == NULL) {
+      std::cerr << "Couldn't open step file " << fileName << "!" << std::endl;
+      return false;
+    }
+    std::string text(sourceStat.st_size, '\0');
+    size_t nRead = fread(&text[0], 1, text.size(), rfile);
+    fclose(rfile);
+    text.resize(nRead);
+    const char *p = text.c_str();
+    const char *end = p + text.size();
+
+    // Header: number of steps and number of bunches.
+    bool newLine = true;
+    int header[2] = {0, 0};
+    for (int i=0; i<2; ++i) {
+      char *next;
+      if (!skipToToken(p, end, newLine)) break;
+      header[i] = strtol(p, &next, 10);
+      if (next == p) {
+	std::cerr << "Malformed header in step file " << fileName << std::endl;
+	return false;
+      }
+      p = next;
+      newLine = false;
+    }
+    int nSteps = header[0];
+    int nBunches = header[1];
+
+    if (format == kTrackLumiZC && nChannels < 0) {
+      const char *q = p;
+      bool nl = newLine;
+      nChannels = skipToToken(q, end, nl) ? std::max(fieldsOnLine(q, end) - 8, 0) : 0;
+    }
+    if (format != kTrackLumiZC) nChannels = 0;
+
+    // Parse into one vector per column.
+    const int nScalarColumns = (format == kTrackLumiZC ? 8 : 7);
+    std::vector<std::vector<int32_t> > intColumns(nScalarColumns);
+    std::vector<std::vector<float> > floatColumns(nScalarColumns);
+    std::vector<double> totLumi;
+    std::vector<std::vector<int32_t> > channelColumns(nChannels);
+    // which columns are floats (TrackLumiZC) or the double (CombinedRates)
+    const bool isFloat[8] = {false, false, false, true, true, false, true, true};
+
+    // If the file has fewer steps than its header says (or something that isn't a number), the remaining steps
+    // repeat the last value read in each column, which is what the fscanf loops this replaced gave.
+    bool exhausted = false;
+    int nComplete = 0;
+    for (int n=0; n<nSteps; ++n) {
+      for (int c=0; c<nScalarColumns+nChannels; ++c) {
+	if (format == kCombinedRates && c == 6)
+	  readField(p, end, newLine, exhausted, totLumi);
+	else if (format == kTrackLumiZC && c < nScalarColumns && isFloat[c])
+	  readField(p, end, newLine, exhausted, floatColumns[c]);
+	else if (c < nScalarColumns)
+	  readField(p, end, newLine, exhausted, intColumns[c]);
+	else
+	  readField(p, end, newLine, exhausted, channelColumns[c-nScalarColumns]);
+      }
+      if (!exhausted) ++nComplete;
+    }
+    if (nComplete < nSteps)
+      std::cerr << "Step file " << fileName << " has only " << nComplete << " of " << nSteps
+		<< " steps; the last step is repeated for the rest" << std::endl;
+
+    // Now lay out the columns in the buffer.
+    std::vector<size_t> sizes = columnSizes(format);
+    CacheHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, cacheMagic, sizeof(cacheMagic));
+    h.version = cacheVersion;
+    h.format = format;
+    h.sourceSize = sourceStat.st_size;
+    h.sourceMtimeSec = sourceStat.st_mtime;
+    h.sourceMtimeNsec = mtimeNsec(sourceStat);
+    h.nSteps = nSteps;
+    h.nBunches = nBunches;
+    h.nChannels = nChannels;
+    h.nColumns = sizes.size();
+    size_t offset = sizeof(CacheHeader);
+    for (unsigned int c=0; c<sizes.size(); ++c) {
+      offset = (offset + columnAlignment - 1)/columnAlignment*columnAlignment;
+      h.columnOffset[c] = offset;
+      offset += sizes[c]*nSteps*(c == (unsigned int)nScalarColumns ? nChannels : 1);
+    }
+    buffer.assign(offset, 0);
+    memcpy(buffer.data(), &h, sizeof(h));
+    for (int c=0; c<nScalarColumns; ++c) {
+      char *dest = buffer.data() + h.columnOffset[c];
+      if (format == kCombinedRates && c == 6)
+	memcpy(dest, totLumi.data(), nSteps*sizeof(double));
+      else if (format == kTrackLumiZC && isFloat[c])
+	memcpy(dest, floatColumns[c].data(), nSteps*sizeof(float));
+      else
+	memcpy(dest, intColumns[c].data(), nSteps*sizeof(int32_t));
+    }
+    for (int j=0; j<nChannels; ++j)
+      memcpy(buffer.data() + h.columnOffset[nScalarColumns] + (size_t)j*nSteps*sizeof(int32_t),
+	     channelColumns[j].data(), nSteps*sizeof(int32_t));
+    setViews();
+    return true;
+  }
+
+  // Write the buffer to the binary file. This goes to a temporary file first, so that a partly-written file
+  // is never picked up. Failure isn't fatal since we still have the data in memory.
+  void writeCache(const std::string& cacheName) {
+    char tmpName[4096];
+    snprintf(tmpName, sizeof(tmpName), "%s.tmp%d_%p", cacheName.c_str(), (int)getpid(), (void*)this);
+    FILE *wfile = fopen(tmpName, "wb");
+    if (wfile == NULL) return;
+    bool ok = (fwrite(buffer.data(), 1, buffer.size(), wfile) == buffer.size());
+    ok = (fclose(wfile) == 0) && ok;
+    if (!ok || rename(tmpName, cacheName.c_str()) != 0)
+      remove(tmpName);
+  }
+};
+
+} // namespace PLTStepFile
+
+#endif
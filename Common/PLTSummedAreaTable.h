@@ -0,0 +1,98 @@
+////////////////////////////////////////////////////////////////////
+//
+// PLTSummedAreaTable.h -- summed-area table (integral image) for a
+// 2D map such as a ROC occupancy histogram. After building the table
+// once, the sum over any rectangle of pixels is four lookups, so
+// many different rectangles (e.g. mask geometries) can be tried
+// without going back over the pixels each time.
+//
+////////////////////////////////////////////////////////////////////
+
+#ifndef PLTSUMMEDAREATABLE_H
+#define PLTSUMMEDAREATABLE_H
+
+#include <vector>
+#include <algorithm>
+
+// A rectangle of pixels, columns [colMin, colMax) and rows [rowMin, rowMax).
+struct PixelRect {
+  int colMin, colMax, rowMin, rowMax;
+
+  int nCols() const { return colMax > colMin ? colMax-colMin : 0; }
+  int nRows() const { return rowMax > rowMin ? rowMax-rowMin : 0; }
+  int area() const { return nCols()*nRows(); }
+
+  // A rectangle of the given size centered at (colCenter, rowCenter). If the size is odd, the extra pixel goes
+  // on the low side.
+  static PixelRect centered(double colCenter, double rowCenter, int cols, int rows) {
+    PixelRect r;
+    r.colMin = (int)(colCenter - cols/2.0 + 0.5);
+    r.colMax = r.colMin + cols;
+    r.rowMin = (int)(rowCenter - rows/2.0 + 0.5);
+    r.rowMax = r.rowMin + rows;
+    return r;
+  }
+
+  PixelRect intersect(const PixelRect& o) const {
+    PixelRect r;
+    r.colMin = std::max(colMin, o.colMin);
+    r.colMax = std::min(colMax, o.colMax);
+    r.rowMin = std::max(rowMin, o.rowMin);
+    r.rowMax = std::min(rowMax, o.rowMax);
+    return r;
+  }
+};
+
+class SummedAreaTable {
+public:
+  SummedAreaTable(): nCols(0), nRows(0) {}
+
+  // values is indexed [col][row], i.e. values[col*rows + row].
+  SummedAreaTable(int cols, int rows, const std::vector<double>& values) { build(cols, rows, values); }
+
+  void build(int cols, int rows, const std::vector<double>& values) {
+    nCols = cols;
+    nRows = rows;
+    // table(c, r) is the sum of all pixels with col < c and row < r, so it has an extra row and column of
+    // zeros at the start.
+    table.assign((size_t)(cols+1)*(rows+1), 0);
+    for (int c=0; c<cols; ++c) {
+      double columnSum = 0;
+      for (int r=0; r<rows; ++r) {
+	columnSum += values[(size_t)c*rows + r];
+	at(c+1, r+1) = at(c, r+1) + columnSum;
+      }
+    }
+  }
+
+  // Build from a TH2 (or anything else with the same interface). Bin (i, j) is taken to be column i-1, row
+  // j-1; the under- and overflow bins are ignored. Written as a template so that this header doesn't need ROOT.
+  template <typename H> void buildFromHistogram(const H *h) {
+    int cols = h->GetNbinsX(), rows = h->GetNbinsY();
+    std::vector<double> values((size_t)cols*rows);
+    for (int c=0; c<cols; ++c)
+      for (int r=0; r<rows; ++r)
+	values[(size_t)c*rows + r] = h->GetBinContent(c+1, r+1);
+    build(cols, rows, values);
+  }
+
+  // Sum over the rectangle (clipped to the map).
+  double sum(const PixelRect& rect) const {
+    int c0 = std::max(rect.colMin, 0), c1 = std::min(rect.colMax, nCols);
+    int r0 = std::max(rect.rowMin, 0), r1 = std::min(rect.rowMax, nRows);
+    if (c1 <= c0 || r1 <= r0) return 0;
+    return at(c1, r1) - at(c0, r1) - at(c1, r0) + at(c0, r0);
+  }
+  double total() const { return nCols > 0 ? at(nCols, nRows) : 0; }
+  int cols() const { return nCols; }
+  int rows() const { return nRows; }
+
+private:
+  double& at(int c, int r) { return table[(size_t)c*(nRows+1) + r]; }
+  double at(int c, int r) const { return table[(size_t)c*(nRows+1) + r]; }
+
+  int nCols, nRows;
+  std::vector<double> table;
+};
+
+#endif
@@ -0,0 +1,178 @@
+////////////////////////////////////////////////////////////////////
+//
+// PLTTimeAlign.h -- tools for matching up PLT steps with luminosity
+// (or background, etc.) values from other sources, e.g. the per-LS
+// brilcalc output for HFOC or PLTZERO or the BCM1F/PLTZ background
+// files.
+//
+// The luminometer series must be sorted in time, as brilcalc output
+// is. The PLT steps are then matched up against them in a single
+// pass through both, rather than searching the whole series for
+// every step. Two ways of matching are provided:
+// - kPreceding: take the value of the last lumisection starting at
+//   or before the given time (what findLumi() used to do)
+// - kOverlap: average the values of all of the lumisections which
+//   overlap the step, weighted by the amount of time they overlap
+//
+////////////////////////////////////////////////////////////////////
+
+#ifndef PLTTIMEALIGN_H
+#define PLTTIMEALIGN_H
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <time.h>
+
+namespace PLTTimeAlign {
+
+enum Mode { kPreceding, kOverlap };
+
+// Length of a lumisection (2^18 orbits) in seconds.
+const double lumiSectionLength = 23.31;
+
+// A luminometer time series: the start time of each lumisection (or measurement) and the value for it.
+struct LumiSeries {
+  std::string name;
+  std::vector<double> timestamps;
+  std::vector<double> values;
+};
+
+// The PLT timestamps are in ms since midnight (UTC) of the day of the fill. This returns the offset (in
+// seconds) to add to convert them to Unix time, given some reference time during the fill (usually the first
+// brilcalc timestamp). Compute this once and then use pltToUnix() for each timestamp.
+inline int dayOffset(int referenceTime) {
+  time_t reftt = referenceTime;
+  struct tm *tmp = gmtime(&reftt);
+  // Get midnight of this day.
+  tmp->tm_hour = 0;
+  tmp->tm_min = 0;
+  tmp->tm_sec = 0;
+  // Get the timestamp corresponding to that.
+  time_t dayMidnight = mktime(tmp);
+  // I still need to do DST. not sure why!
+  return dayMidnight+3600;
+}
+
+inline int pltToUnix(int pltTime, int offset) {
+  return (pltTime/1000)+offset;
+}
+
+// Return the series value for each time in times, using the kPreceding method. This is fastest if times is
+// sorted, but will still work if it isn't.
+inline std::vector<double> alignToTimes(const std::vector<double>& seriesTimes, const std::vector<double>& seriesValues,
+					const std::vector<double>& times) {
+  std::vector<double> result(times.size(), 0);
+  const size_t n = seriesTimes.size();
+  if (n == 0) return result;
+  size_t cursor = 0;
+  for (size_t i=0; i<times.size(); ++i) {
+    const double t = times[i];
+    // If we went backwards, start over with a binary search.
+    if (t < seriesTimes[cursor]) {
+      size_t pos = std::upper_bound(seriesTimes.begin(), seriesTimes.end(), t) - seriesTimes.begin();
+      cursor = (pos > 0 ? pos-1 : 0);
+    }
+    while (cursor+1 < n && seriesTimes[cursor+1] <= t)
+      ++cursor;
+    result[i] = seriesValues[cursor];
+  }
+  return result;
+}
+
+// Return the series value for each interval [begins[i], ends[i]). For kPreceding, this is the value at the
+// midpoint of the interval. For kOverlap, each lumisection is taken to last until the start of the next one
+// (or lumiSectionLength, if there's a gap or it's the last one) and the values of all of the lumisections
+// overlapping the interval are averaged, weighted by the overlap. If there aren't any, this falls back to
+// kPreceding.
+inline std::vector<double> alignToIntervals(const std::vector<double>& seriesTimes, const std::vector<double>& seriesValues,
+					    const std::vector<double>& begins, const std::vector<double>& ends,
+					    Mode mode = kOverlap) {
+  std::vector<double> midpoints(begins.size());
+  for (size_t i=0; i<begins.size(); ++i)
+    midpoints[i] = (begins[i]+ends[i])/2;
+  std::vector<double> result = alignToTimes(seriesTimes, seriesValues, midpoints);
+  if (mode == kPreceding || seriesTimes.empty()) return result;
+
+  const size_t n = seriesTimes.size();
+  size_t cursor = 0;
+  for (size_t i=0; i<begins.size(); ++i) {
+    const double b = begins[i], e = ends[i];
+    if (cursor > 0 && b < seriesTimes[cursor]) {
+      size_t pos = std::upper_bound(seriesTimes.begin(), seriesTimes.end(), b) - seriesTimes.begin();
+      cursor = (pos > 0 ? pos-1 : 0);
+    }
+    double sum = 0, weight = 0;
+    for (size_t j=cursor; j<n && seriesTimes[j] < e; ++j) {
+      double lsEnd = seriesTimes[j] + lumiSectionLength;
+      if (j+1 < n && seriesTimes[j+1] < lsEnd) lsEnd = seriesTimes[j+1];
+      // Lumisections ending before this interval won't overlap any later intervals either.
+      if (lsEnd <= b) {
+	cursor = j+1;
+	continue;
+      }
+      double overlap = std::min(e, lsEnd) - std::max(b, seriesTimes[j]);
+      if (overlap > 0) {
+	sum += seriesValues[j]*overlap;
+	weight += overlap;
+      }
+    }
+    if (cursor >= n) cursor = n-1;
+    if (weight > 0) result[i] = sum/weight;
+  }
+  return result;
+}
+
+// Incremental version of the above, for a series which is still growing (e.g. when following a fill as it
+// happens). The cursor remembers where the last step was matched, so each new step only looks at the
+// lumisections added since then. Steps must be given in time order. Before asking for a value, use complete()
+// to check that the series already extends past the step, since otherwise a later lumisection might still
+// change the answer.
+class SeriesCursor {
+public:
+  SeriesCursor(): cursor(0) {}
+
+  // True if the series has a lumisection starting after t, so the values up to t won't change any more.
+  bool complete(const std::vector<double>& seriesTimes, double t) const {
+    return !seriesTimes.empty() && seriesTimes.back() > t;
+  }
+
+  // Value of the last lumisection starting at or before t (kPreceding).
+  double preceding(const std::vector<double>& seriesTimes, const std::vector<double>& seriesValues, double t) {
+    const size_t n = seriesTimes.size();
+    if (n == 0) return 0;
+    while (cursor+1 < n && seriesTimes[cursor+1] <= t)
+      ++cursor;
+    return seriesValues[cursor];
+  }
+
+  // Value for the interval [b, e) using the given mode, as in alignToIntervals().
+  double interval(const std::vector<double>& seriesTimes, const std::vector<double>& seriesValues,
+		  double b, double e, Mode mode = kOverlap) {
+    double result = preceding(seriesTimes, seriesValues, (b+e)/2);
+    if (mode == kPreceding) return result;
+    // preceding() may have moved the cursor past lumisections overlapping the start of the interval, so back
+    // up to the one containing b.
+    size_t j = cursor;
+    while (j > 0 && seriesTimes[j] > b)
+      --j;
+    double sum = 0, weight = 0;
+    for (; j<seriesTimes.size() && seriesTimes[j] < e; ++j) {
+      double lsEnd = seriesTimes[j] + lumiSectionLength;
+      if (j+1 < seriesTimes.size() && seriesTimes[j+1] < lsEnd) lsEnd = seriesTimes[j+1];
+      double overlap = std::min(e, lsEnd) - std::max(b, seriesTimes[j]);
+      if (overlap > 0) {
+	sum += seriesValues[j]*overlap;
+	weight += overlap;
+      }
+    }
+    return weight > 0 ? sum/weight : result;
+  }
+
+private:
+  size_t cursor;
+};
+
+} // namespace PLTTimeAlign
+
+#endif
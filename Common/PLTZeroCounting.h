@@ -0,0 +1,145 @@
+////////////////////////////////////////////////////////////////////
+//
+// PLTZeroCounting.h -- the zero-counting luminosity calculation,
+// mu = -log(fraction of empty triggers), together with its binomial
+// error, for blocks of steps x channels x bunches at once.
+//
+// The counts are stored as a structure of arrays with the step
+// index innermost, so that all of the loops below run over
+// contiguous arrays without any branches and can be vectorized by
+// the compiler. This makes it cheap to do the channel averaging the
+// correct way, i.e. computing mu for every channel and averaging
+// the mu values, rather than averaging the counts first.
+//
+////////////////////////////////////////////////////////////////////
+
+#ifndef PLTZEROCOUNTING_H
+#define PLTZEROCOUNTING_H
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+namespace PLTZeroCounting {
+
+// Compute mu = -log(1 - nFull/nTrig) for n measurements. If muErr is given, also compute the binomial error on
+// the zero fraction, propagated through the log and symmetrized. The number of samples for the binomial error
+// is nTrig*samplesFactor, so e.g. when nFull is the average over N channels, samplesFactor should be N.
+template <typename T>
+inline void computeMu(int n, const T* __restrict nFull, const int* __restrict nTrig, double samplesFactor,
+		      double* __restrict mu, double* __restrict muErr = nullptr) {
+  for (int i=0; i<n; ++i)
+    mu[i] = -log(1.0-(double)nFull[i]/nTrig[i]);
+  if (!muErr) return;
+  for (int i=0; i<n; ++i) {
+    double zeroFrac = 1.0-(double)nFull[i]/nTrig[i];
+    double zeroFracErr = sqrt(zeroFrac*(1-zeroFrac)/(nTrig[i]*samplesFactor));
+    double muPlus = -log(zeroFrac + zeroFracErr);
+    double muMinus = -log(zeroFrac - zeroFracErr);
+    muErr[i] = (std::abs(muPlus-mu[i]) + std::abs(muMinus-mu[i]))/2;
+  }
+}
+
+// A block of counts for nSteps steps, nChannels channels, and nBunches bunches. The full-trigger counts are
+// indexed [channel][bunch][step] and the number of triggers [bunch][step]. For data which isn't per-bunch,
+// just use nBunches = 1.
+struct CountBlock {
+  int nSteps, nChannels, nBunches;
+  std::vector<float> nFull;
+  std::vector<int> nTrig;
+
+  CountBlock(int steps = 0, int channels = 0, int bunches = 1) { resize(steps, channels, bunches); }
+  void resize(int steps, int channels, int bunches = 1) {
+    nSteps = steps;
+    nChannels = channels;
+    nBunches = bunches;
+    nFull.assign((size_t)channels*bunches*steps, 0);
+    nTrig.assign((size_t)bunches*steps, 0);
+  }
+  float *full(int channel, int bunch = 0) { return &nFull[((size_t)channel*nBunches + bunch)*nSteps]; }
+  const float *full(int channel, int bunch = 0) const { return &nFull[((size_t)channel*nBunches + bunch)*nSteps]; }
+  int *trig(int bunch = 0) { return &nTrig[(size_t)bunch*nSteps]; }
+  const int *trig(int bunch = 0) const { return &nTrig[(size_t)bunch*nSteps]; }
+};
+
+// mu and its error for every entry of a CountBlock, in the same [channel][bunch][step] layout.
+struct ChannelMu {
+  int nSteps, nChannels, nBunches;
+  std::vector<double> mu, muErr;
+
+  const double *channelMu(int channel, int bunch = 0) const { return &mu[((size_t)channel*nBunches + bunch)*nSteps]; }
+  const double *channelMuErr(int channel, int bunch = 0) const { return &muErr[((size_t)channel*nBunches + bunch)*nSteps]; }
+};
+
+inline ChannelMu computeChannelMu(const CountBlock& block) {
+  ChannelMu result;
+  result.nSteps = block.nSteps;
+  result.nChannels = block.nChannels;
+  result.nBunches = block.nBunches;
+  result.mu.resize(block.nFull.size());
+  result.muErr.resize(block.nFull.size());
+  for (int c=0; c<block.nChannels; ++c) {
+    for (int b=0; b<block.nBunches; ++b) {
+      size_t offset = ((size_t)c*block.nBunches + b)*block.nSteps;
+      computeMu(block.nSteps, block.full(c, b), block.trig(b), 1.0, &result.mu[offset], &result.muErr[offset]);
+    }
+  }
+  return result;
+}
+
+// Average the per-channel mu values over the good channels, giving avgMu and avgErr indexed [bunch][step].
+// good is indexed [channel][step] (nonzero = good); if it's null, all channels are used. When some channels
+// are excluded, the average is corrected for the fraction of the total that they made up in the first step,
+// in the same way that ChannelDropoutDetector does for the counts, so that it doesn't jump when a channel
+// drops out. The errors on the individual channels are treated as independent.
+inline void averageChannels(const ChannelMu& channelMu, const unsigned char *good,
+			    std::vector<double>& avgMu, std::vector<double>& avgErr) {
+  const int nSteps = channelMu.nSteps, nChannels = channelMu.nChannels, nBunches = channelMu.nBunches;
+  avgMu.assign((size_t)nBunches*nSteps, 0);
+  avgErr.assign((size_t)nBunches*nSteps, 0);
+  if (nSteps == 0 || nChannels == 0) return;
+  std::vector<double> sumWeight(nSteps), sumErr2(nSteps);
+
+  for (int b=0; b<nBunches; ++b) {
+    // The fraction of the total in each channel at the start.
+    std::vector<double> weight(nChannels);
+    double sum0 = 0;
+    for (int c=0; c<nChannels; ++c)
+      sum0 += channelMu.channelMu(c, b)[0];
+    for (int c=0; c<nChannels; ++c)
+      weight[c] = (sum0 > 0 ? channelMu.channelMu(c, b)[0]/sum0 : 1.0/nChannels);
+
+    double *sumMu = &avgMu[(size_t)b*nSteps];
+    double *avgE = &avgErr[(size_t)b*nSteps];
+    std::fill(sumWeight.begin(), sumWeight.end(), 0);
+    std::fill(sumErr2.begin(), sumErr2.end(), 0);
+    for (int c=0; c<nChannels; ++c) {
+      const double *mu = channelMu.channelMu(c, b);
+      const double *err = channelMu.channelMuErr(c, b);
+      if (good) {
+	const unsigned char *g = good + (size_t)c*nSteps;
+	for (int s=0; s<nSteps; ++s) {
+	  double m = (g[s] ? 1.0 : 0.0);
+	  sumMu[s] += m*mu[s];
+	  sumWeight[s] += m*weight[c];
+	  sumErr2[s] += m*err[s]*err[s];
+	}
+      } else {
+	for (int s=0; s<nSteps; ++s) {
+	  sumMu[s] += mu[s];
+	  sumWeight[s] += weight[c];
+	  sumErr2[s] += err[s]*err[s];
+	}
+      }
+    }
+    for (int s=0; s<nSteps; ++s) {
+      double norm = nChannels*sumWeight[s];
+      sumMu[s] = (norm > 0 ? sumMu[s]/norm : 0);
+      avgE[s] = (norm > 0 ? sqrt(sumErr2[s])/norm : 0);
+    }
+  }
+}
+
+} // namespace PLTZeroCounting
+
+#endif
@@ -0,0 +1,298 @@
+////////////////////////////////////////////////////////////////////
+//
+// TrackLumiFillTools.h -- pieces of the fill track luminosity
+// analysis which are shared between PlotTrackLumiFillPaper.C (which
+// processes a whole fill at once) and MonitorTrackLumiFill.C (which
+// follows the step file as it is written during the fill). The
+// classes carry their state forward one step at a time, so nothing
+// has to be recomputed when a new step arrives. The functions at the
+// end do the whole-fill calculation for PlotTrackLumiFillPaper.C,
+// and are also what Benchmarks/BenchmarkPLT.C times.
+//
+////////////////////////////////////////////////////////////////////
+
+#ifndef TRACKLUMIFILLTOOLS_H
+#define TRACKLUMIFILLTOOLS_H
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cmath>
+#include "../Common/PLTCSVFile.h"
+#include "../Common/PLTStepFile.h"
+#include "../Common/PLTTimeAlign.h"
+#include "../Common/PLTZeroCounting.h"
+
+// The automatic channel dropout detection. Basically, this stores all of the ratios of the channels to the
+// total at the start of the fill, and if that ratio changes by more than 10%, we flag the channel bad and
+// exclude it from the total for the remainder of the fill.
+struct ChannelDropoutDetector {
+  int nChannels;
+  std::vector<bool> channelStillGood;
+  std::vector<float> channelRatios;
+  float totalNormalization;
+  bool ratiosFilled;
+
+  ChannelDropoutDetector(int n): nChannels(n), channelStillGood(n, true), channelRatios(n, 0),
+				 totalNormalization(1), ratiosFilled(false) {}
+
+  // Process the per-channel track counts for the next step and return the all-channel average recalculated
+  // using only the channels which are still good. If verbose is set, print a message when a channel goes bad.
+  float update(const int *channelTracks, int tBegin, bool verbose) {
+    int sumChannelTracks = 0;
+    for (int j=0; j<nChannels; ++j)
+      sumChannelTracks += channelTracks[j];
+
+    // If this is the first data point, store the channel ratios so we can use them again.
+    if (!ratiosFilled) {
+      for (int j=0; j<nChannels; ++j)
+	channelRatios[j] = (float)channelTracks[j]/sumChannelTracks;
+      ratiosFilled = true;
+    }
+
+    // Check to see if any channel has gone bad.
+    for (int j=0; j<nChannels; ++j) {
+      if (!channelStillGood[j]) continue;
+      float thisChannelRatio = (float)channelTracks[j]/sumChannelTracks;
+      if (std::abs(thisChannelRatio/channelRatios[j] - 1) > 0.1) {
+	if (verbose)
+	  std::cout << "Channel " << j << " gone bad at " << tBegin << std::endl;
+	channelStillGood[j] = false;
+	totalNormalization -= channelRatios[j];
+      }
+    }
+
+    // Recalculate the average based on the good channels. Note -- the fully correct thing to do would be to
+    // average after calculating the mu values, rather than before, but when I quickly checked the results
+    // seem to be nearly indistinguishable, so I think it's OK to do it the simple way. (The correct way can be
+    // done with PLTZeroCounting::averageChannels, using channelStillGood as the mask; see averageChannelMu in
+    // PlotTrackLumiFillPaper.C.)
+    int sumGoodChannels = 0;
+    for (int j=0; j<nChannels; ++j) {
+      if (channelStillGood[j])
+	sumGoodChannels += channelTracks[j];
+    }
+    return float(sumGoodChannels)/(nChannels*totalNormalization);
+  }
+
+  int nGood() const {
+    int n = 0;
+    for (int j=0; j<nChannels; ++j)
+      if (channelStillGood[j]) ++n;
+    return n;
+  }
+};
+
+// Running mean and RMS (Welford's method).
+struct RunningStats {
+  long n;
+  double mean, m2;
+
+  RunningStats(): n(0), mean(0), m2(0) {}
+  void add(double x) {
+    ++n;
+    double delta = x - mean;
+    mean += delta/n;
+    m2 += delta*(x - mean);
+  }
+  double rms() const { return n > 1 ? sqrt(m2/(n-1)) : 0; }
+};
+
+// Running unweighted straight-line fit y = p0 + p1*x, giving the same result as fitting pol1 to a TGraph with
+// all of the points so far. The parameter errors are scaled by the residual spread, as ROOT does for graphs
+// without errors.
+struct LinearFitAccumulator {
+  long n;
+  double sx, sy, sxx, sxy, syy;
+
+  LinearFitAccumulator(): n(0), sx(0), sy(0), sxx(0), sxy(0), syy(0) {}
+  void add(double x, double y) {
+    ++n;
+    sx += x;
+    sy += y;
+    sxx += x*x;
+    sxy += x*y;
+    syy += y*y;
+  }
+  double det() const { return n*sxx - sx*sx; }
+  bool valid() const { return n >= 2 && det() != 0; }
+  double p1() const { return valid() ? (n*sxy - sx*sy)/det() : 0; }
+  double p0() const { return valid() ? (sy - p1()*sx)/n : (n > 0 ? sy/n : 0); }
+  // residual variance per degree of freedom
+  double sigma2() const {
+    if (n <= 2 || !valid()) return 0;
+    double chi2 = syy - p0()*sy - p1()*sxy;
+    return chi2 > 0 ? chi2/(n-2) : 0;
+  }
+  double p0Err() const { return valid() ? sqrt(sigma2()*sxx/det()) : 0; }
+  double p1Err() const { return valid() ? sqrt(sigma2()*n/det()) : 0; }
+};
+
+// Follow a text file which is still being written, returning the complete lines added since the last call.
+// A partial line at the end of the file is held back until it's finished. If the file is truncated or
+// replaced, reading starts over from the beginning, and restarted() is true after that call, so that the caller
+// can throw away whatever it has built up from the old contents.
+class TextFileTailer {
+public:
+  TextFileTailer(const std::string& name): fileName(name), position(0), wasRestarted(false) {}
+
+  // Append any new complete lines to lines. Returns the number of lines added.
+  int readNewLines(std::vector<std::string>& lines) {
+    wasRestarted = false;
+    std::ifstream file(fileName.c_str(), std::ios::binary);
+    if (!file.is_open()) return 0;
+    file.seekg(0, std::ios::end);
+    std::streamoff size = file.tellg();
+    if (size < position) {
+      // The file has been truncated or replaced, so start over.
+      rewind();
+      wasRestarted = true;
+    }
+    if (size == position) return 0;
+    file.seekg(position);
+    std::string chunk(size - position, '\0');
+    file.read(&chunk[0], chunk.size());
+    chunk.resize(file.gcount());
+    position += chunk.size();
+
+    partial += chunk;
+    int nAdded = 0;
+    size_t start = 0, end;
+    while ((end = partial.find('\n', start)) != std::string::npos) {
+      lines.push_back(partial.substr(start, end-start));
+      start = end+1;
+      ++nAdded;
+    }
+    partial.erase(0, start);
+    return nAdded;
+  }
+
+  // Whether the last readNewLines() started over from the beginning of the file.
+  bool restarted() const { return wasRestarted; }
+
+  // Start reading from the beginning of the file again on the next readNewLines().
+  void rewind() {
+    position = 0;
+    partial.clear();
+  }
+
+private:
+  std::string fileName;
+  std::streamoff position;
+  std::string partial;
+  bool wasRestarted;
+};
+
+// Parse one line of a brilcalc csv file (see PLTCSV::brilcalcSchema). Returns false for comment or malformed
+// lines. The luminosity is converted to Hz/nb.
+inline bool parseBrilcalcLine(const std::string& line, double& timestamp, double& deliveredLumi) {
+  static const PLTCSV::Schema schema = PLTCSV::brilcalcSchema();
+  PLTCSV::Table row;
+  PLTCSV::initTable(schema, row);
+  std::vector<const char*> fieldStart;
+  if (!PLTCSV::appendLine(line.data(), line.data()+line.size(), schema, row, fieldStart)) return false;
+  timestamp = row.ints(0)[0];
+  deliveredLumi = row.floats(1)[0]/1000.0;
+  return true;
+}
+
+// The track luminosity for each step of a fill, with the times converted to Unix time.
+struct TrackLumiSteps {
+  std::vector<double> timestamps, begins, ends; // middle, beginning, and end of each step
+  std::vector<double> lumiAll, lumiGood, lumiErr;
+};
+
+// Compute the zero-counting luminosity for all of the steps of a fill, running the channel dropout detection
+// as we go. If attemptChannelFix is set, the channels found to have dropped out are excluded from the good
+// track luminosity. If averageChannelMu is set, mu is computed for each channel and then averaged; otherwise
+// it's computed from the average of the counts.
+inline TrackLumiSteps computeTrackLumiSteps(const PLTStepFile::TrackLumiZCSteps& steps, int dayOffset,
+					    bool attemptChannelFix, bool averageChannelMu) {
+  const int nsteps = steps.nSteps;
+  const int nChannels = steps.nChannels;
+  ChannelDropoutDetector dropoutDetector(nChannels);
+  // The counts which go into the zero-counting calculation, stored so that the mu values can be computed for
+  // all of the steps at once after the loop.
+  std::vector<float> nFullSteps(nsteps);
+  PLTZeroCounting::CountBlock channelCounts(nsteps, nChannels);
+  std::vector<unsigned char> channelGood((size_t)nChannels*nsteps, 1);
+  std::vector<int> channelTracks(nChannels);
+  TrackLumiSteps result;
+
+  for (int i=0; i<nsteps; ++i) {
+    for (int j=0; j<nChannels; ++j) {
+      channelTracks[j] = steps.channel(j)[i];
+      channelCounts.full(j)[i] = channelTracks[j];
+    }
+    channelCounts.trig()[i] = steps.nFilledTrig[i];
+
+    // Note that the dropout calculations are always done, but we only replace the final value with the
+    // recalculated value if attemptChannelFix is set.
+    float nFull = steps.nFull[i];
+    float nFullRecalculated = dropoutDetector.update(channelTracks.data(), steps.tBegin[i], attemptChannelFix);
+    if (attemptChannelFix) {
+      nFull = nFullRecalculated;
+      for (int j=0; j<nChannels; ++j)
+	channelGood[(size_t)j*nsteps+i] = dropoutDetector.channelStillGood[j];
+    }
+    nFullSteps[i] = nFull;
+
+    int convertedBeginning = PLTTimeAlign::pltToUnix(steps.tBegin[i], dayOffset);
+    int convertedEnd = PLTTimeAlign::pltToUnix(steps.tEnd[i], dayOffset);
+    float convertedMiddle = (float(convertedBeginning)+float(convertedEnd))/2.0;
+    result.timestamps.push_back(convertedMiddle);
+    result.begins.push_back(convertedBeginning);
+    result.ends.push_back(convertedEnd);
+  }
+
+  // Now compute the luminosity for all of the steps.
+  result.lumiAll.resize(nsteps);
+  result.lumiGood.resize(nsteps);
+  result.lumiErr.resize(nsteps);
+  PLTZeroCounting::computeMu(nsteps, steps.tracksAll, steps.nTrig, 1.0, result.lumiAll.data());
+  if (averageChannelMu) {
+    PLTZeroCounting::ChannelMu channelMu = PLTZeroCounting::computeChannelMu(channelCounts);
+    PLTZeroCounting::averageChannels(channelMu, channelGood.data(), result.lumiGood, result.lumiErr);
+  } else {
+    // nFull is the average over all channels, so there are really nFilledTrig*nChannels samples.
+    PLTZeroCounting::computeMu(nsteps, nFullSteps.data(), channelCounts.trig(), nChannels,
+			       result.lumiGood.data(), result.lumiErr.data());
+  }
+  return result;
+}
+
+// Scale the track luminosity so that it agrees with the luminometer value aligned to it at step scaleStep.
+// Returns the scale factor.
+inline float normalizeTrackLumi(std::vector<double>& trackLumi, const std::vector<double>& aligned, int scaleStep) {
+  float scaleTarget = aligned[scaleStep];
+  float scaleFactor = scaleTarget/trackLumi[scaleStep];
+  for (std::vector<double>::iterator it = trackLumi.begin(); it != trackLumi.end(); ++it) {
+    *it *= scaleFactor;
+  }
+  return scaleFactor;
+}
+
+// The ratio of the track luminosity to a luminometer for each step, and for the fit vs. SBIL, the ratios which
+// are in the range 0.95-1.05 together with the luminometer SBIL.
+struct LumiRatios {
+  std::vector<double> ratio;
+  std::vector<double> ratioClean, sbilClean;
+};
+
+inline LumiRatios computeLumiRatios(const std::vector<double>& trackLumi, const std::vector<double>& aligned,
+				    int nBunches) {
+  LumiRatios r;
+  for (unsigned int i=0; i<trackLumi.size(); ++i) {
+    float lumi = aligned[i];
+    double thisRatio = trackLumi[i]/lumi;
+    r.ratio.push_back(thisRatio);
+    if (std::abs(thisRatio-1) < 0.05) {
+      r.ratioClean.push_back(thisRatio);
+      r.sbilClean.push_back(lumi*1000/nBunches);
+    }
+  }
+  return r;
+}
+
+#endif
@@ -0,0 +1,344 @@
+#!/usr/bin/env python3
+#
+# makeFigures.py -- regenerate the paper figures. Each figure is listed
+# in FIGURES below with the macro (and arguments) that makes it, the
+# data files it reads, and the files it writes. A figure is only rerun
+# if the contents of the macro (including any local files it
+# #includes), its arguments, its input files, or the ROOT version have
+# changed since the last time it was made successfully, or if one of
+# its outputs is missing. Figures are run in batch mode in separate
+# ROOT processes, several at once, and the time taken for each one is
+# printed at the end.
+#
+# Usage:
+#   ./makeFigures.py                 make all figures which are out of date
+#   ./makeFigures.py fig25 fig29     make only these (and anything they depend on)
+#   ./makeFigures.py -j 8 -f         use 8 processes, and remake everything regardless
+#   ./makeFigures.py -l              list the figures and whether they're up to date
+#
+# The hashes are stored in .figures/cache.json and the output of each
+# ROOT process in .figures/logs/<figure>.log.
+#
+# If a figure reads a file which is an output of another figure, that
+# figure is made first.
+
+import fnmatch
+import glob
+import hashlib
+import json
+import optparse
+import os
+import re
+import subprocess
+import sys
+import time
+from concurrent.futures import ThreadPoolExecutor, FIRST_COMPLETED, wait
+
+top_dir = os.path.dirname(os.path.abspath(__file__))
+work_dir = os.path.join(top_dir, '.figures')
+cache_file = os.path.join(work_dir, 'cache.json')
+log_dir = os.path.join(work_dir, 'logs')
+
+
+def figure(name, directory, macro, args='', inputs=(), outputs=()):
+    """A figure: macro (with args) is run in directory. inputs and outputs are file names or glob patterns
+    relative to directory."""
+    return {'name': name, 'dir': directory, 'macro': macro, 'args': args,
+            'inputs': list(inputs), 'outputs': list(outputs)}
+
+
+def both(base):
+    return [base + '.png', base + '.pdf']
+
+
+FIGURES = [
+    figure('fig2', '.', 'DrawPLTReadoutChannels.C', outputs=both('PLTReadoutChannels')),
+    figure('fig5', 'Alignment', 'MakeTrackOccupancyPaper.C',
+           inputs=['histo_track_occupancy_4892.root'], outputs=both('TrackOccupancies4892')),
+    figure('fig6', 'Alignment', 'PlotAlignment4444Paper.C',
+           inputs=['alignment_4444_30M.root'], outputs=both('Alignment_XdY_4444_Ch7_ROC1')),
+    figure('fig7', 'Alignment', 'PlotAlignmentVsTimePaper.C',
+           inputs=['Alignment2015/*.dat'],
+           outputs=['AlignmentVsTime_Ch*.png', 'AlignmentVsTime_Ch*.pdf', 'AlignmentVsTime_Summary.png']),
+    figure('fig8_2015', 'AccidentalRates', 'PlotAccidentalRatesPaper.C', args='0',
+           inputs=['AccidentalData/CombinedRates*.txt'], outputs=both('AccidentalRates2015')),
+    figure('fig8_2016', 'AccidentalRates', 'PlotAccidentalRatesPaper.C', args='1',
+           inputs=['AccidentalData/CombinedRates*.txt'], outputs=both('AccidentalRates2016')),
+    figure('fig8_slopes', 'AccidentalRates', 'PlotAccidentalSlopesPaper.C',
+           inputs=['AccidentalData/CombinedRates*.txt'], outputs=both('AccidentalSlopes2016')),
+    figure('fig9', 'AccidentalLikelihood', 'fit_model_ggg_g.C',
+           inputs=['Fill_4979_v2.root'],
+           outputs=both('AccidentalLikelihoodFit_4979') + both('AccidentalLikelihoodFit_4979_preliminary')),
+    figure('fig9_fill', 'AccidentalLikelihood', 'FitAccidentalsFill.C',
+           inputs=['Fill_4979_v2.root'],
+           outputs=['AccidentalLikelihoodFill_4979.txt'] + both('AccidentalLikelihoodVsTime_4979') +
+           both('AccidentalLikelihoodVsSBIL_4979')),
+    figure('fig10', 'MaskStudies', 'PlotAccidentalRatesMasks.C',
+           inputs=['CombinedRates_4892*.txt'], outputs=both('AccidentalRate_MaskCalibration')),
+    figure('fig10_scan', 'MaskStudies', 'ScanMaskGeometries.C',
+           inputs=['CombinedRates_4892*.txt', '../Alignment/histo_track_occupancy_4892.root'],
+           outputs=['MaskScan_4892.txt'] + both('MaskScan_4892')),
+    figure('fig17', 'Background', 'PlotPLTBackground.C',
+           inputs=['background_*.csv'], outputs=both('PLTBackgroundNoncoll') + both('PLTBackgroundPrecoll')),
+    figure('fig23_eff', 'EmittanceScans', 'PlotEmittanceScanFOM2017.C',
+           inputs=['PLTFOM2017.csv'], outputs=both('EfficiencyCorrections2017')),
+    figure('fig23_lin', 'EmittanceScans', 'PlotSlopeFit.C',
+           inputs=['6325_orig_scan1.csv', '6325_orig_scan2.csv'], outputs=both('SlopeFit_6325_orig')),
+    figure('fig25', 'PLTRamsesComparison', 'PlotRAMSESCorrectionsPaper.C',
+           inputs=['pltramses2016slope.csv', 'pltramses2016ratio.csv'],
+           outputs=both('PLTRAMSESSlope2016') + both('PLTRAMSESRatio2016')),
+    figure('fig29', 'TrackLumi', 'PlotTrackLumiFillPaper.C',
+           inputs=['TrackLumiData/TrackLumiZC_5109.txt', 'TrackLumiData/hfoc_5109.csv',
+                   'TrackLumiData/pltzero_5109.csv'],
+           outputs=both('TrackLumiVsTime_5109') + both('TrackLumiRatiosVsSBIL_5109')),
+    figure('fig30_all', 'TrackLumi', 'PlotTrackLumiVdMPaper.C', args='0',
+           inputs=['TrackLumiData/TrackLumiZC_6016_X4.txt', 'TrackLumiData/TrackLumiZC_6016_Y4.txt',
+                   'TrackLumiData/VdMSteps_6016_AllScans.txt'],
+           outputs=both('TrackLumi_VdM_6016_X4_All') + both('TrackLumi_VdM_6016_Y4_All')),
+    figure('fig31_bx', 'TrackLumi', 'PlotTrackLumiVdMPaper.C', args='1',
+           inputs=['TrackLumiData/TrackLumi_6016_X4_BX/*.txt', 'TrackLumiData/TrackLumi_6016_Y4_BX/*.txt',
+                   'TrackLumiData/VdMSteps_6016_AllScans.txt'],
+           outputs=both('TrackLumi_VdM_6016_4_CapSigmas_BX') + both('TrackLumi_VdM_6016_4_SigmaVis_BX')),
+    figure('fig31_chan', 'TrackLumi', 'PlotTrackLumiVdMPaper.C', args='2',
+           inputs=['TrackLumiData/TrackLumiZC_6016_X4.txt', 'TrackLumiData/TrackLumiZC_6016_Y4.txt',
+                   'TrackLumiData/VdMSteps_6016_AllScans.txt'],
+           outputs=both('TrackLumi_VdM_6016_4_CapSigmas_Chan') + both('TrackLumi_VdM_6016_4_SigmaVis_Chan')),
+    figure('referee_vdm', 'RefereeComments', 'PlotVdMRatesBySide.C',
+           inputs=['VdMRates_4266_BI2?.txt'], outputs=['VdM4266ImagingScan_RatesBySide.png']),
+]
+
+
+def rel(path):
+    return os.path.relpath(path, top_dir)
+
+
+def expand(fig, patterns):
+    """The files matching patterns (relative to the figure's directory), as paths relative to the top
+    directory. Patterns matching nothing are returned in the second list."""
+    files, missing = [], []
+    for pattern in patterns:
+        matches = sorted(glob.glob(os.path.join(top_dir, fig['dir'], pattern)))
+        if matches:
+            files.extend(rel(m) for m in matches)
+        else:
+            missing.append(os.path.normpath(os.path.join(fig['dir'], pattern)))
+    return files, missing
+
+
+include_re = re.compile(r'^\s*#\s*include\s*"([^"]+)"', re.M)
+
+
+def source_files(fig):
+    """The macro and all of the local files it #includes (recursively)."""
+    todo = [os.path.normpath(os.path.join(top_dir, fig['dir'], fig['macro']))]
+    found = []
+    while todo:
+        path = todo.pop()
+        if path in found or not os.path.isfile(path):
+            continue
+        found.append(path)
+        with open(path, errors='replace') as f:
+            for inc in include_re.findall(f.read()):
+                todo.append(os.path.normpath(os.path.join(os.path.dirname(path), inc)))
+    return sorted(rel(p) for p in found)
+
+
+class FileHasher:
+    """sha256 of file contents. The hash is stored with the file's size and modification time, so a file is
+    only read again if one of those changes."""
+
+    def __init__(self, saved):
+        self.saved = saved
+
+    def __call__(self, path):
+        st = os.stat(os.path.join(top_dir, path))
+        entry = self.saved.get(path)
+        if entry and entry['size'] == st.st_size and entry['mtime'] == st.st_mtime_ns:
+            return entry['sha256']
+        h = hashlib.sha256()
+        with open(os.path.join(top_dir, path), 'rb') as f:
+            for block in iter(lambda: f.read(1 << 20), b''):
+                h.update(block)
+        self.saved[path] = {'size': st.st_size, 'mtime': st.st_mtime_ns, 'sha256': h.hexdigest()}
+        return h.hexdigest()
+
+
+def figure_key(fig, hasher, root_version):
+    """The hash of everything that goes into the figure."""
+    h = hashlib.sha256()
+    h.update(('%s\n%s(%s)\n%s\n' % (fig['dir'], fig['macro'], fig['args'], root_version)).encode())
+    inputs, _ = expand(fig, fig['inputs'])
+    for path in source_files(fig) + inputs:
+        h.update(('%s %s\n' % (path, hasher(path))).encode())
+    return h.hexdigest()
+
+
+def outputs_exist(fig, newer_than=0):
+    """True if every output pattern matches at least one file (modified after newer_than)."""
+    for pattern in fig['outputs']:
+        matches = glob.glob(os.path.join(top_dir, fig['dir'], pattern))
+        if not any(os.path.getmtime(m) >= newer_than for m in matches):
+            return False
+    return True
+
+
+def find_dependencies(figures):
+    """deps[name] = the figures which produce one of the inputs of figure name."""
+    deps = {}
+    for fig in figures:
+        deps[fig['name']] = set()
+        for pattern in fig['inputs']:
+            inp = os.path.normpath(os.path.join(fig['dir'], pattern))
+            for other in figures:
+                if other is fig:
+                    continue
+                for out in other['outputs']:
+                    out = os.path.normpath(os.path.join(other['dir'], out))
+                    if fnmatch.fnmatch(inp, out) or fnmatch.fnmatch(out, inp):
+                        deps[fig['name']].add(other['name'])
+    return deps
+
+
+def run_figure(fig, root_command):
+    """Run the macro for fig in batch mode. Returns (success, seconds)."""
+    call = fig['macro'] + ('(%s)' % fig['args'] if fig['args'] else '')
+    log_name = os.path.join(log_dir, fig['name'] + '.log')
+    start = time.time()
+    with open(log_name, 'w') as log:
+        result = subprocess.run([root_command, '-l', '-b', '-q', call], cwd=os.path.join(top_dir, fig['dir']),
+                                stdin=subprocess.DEVNULL, stdout=log, stderr=subprocess.STDOUT)
+    elapsed = time.time() - start
+    # ROOT doesn't always return an error if the macro fails, so also check that the outputs were written.
+    return (result.returncode == 0 and outputs_exist(fig, start - 1)), elapsed
+
+
+def get_root_version(root_command):
+    try:
+        return subprocess.run([root_command + '-config', '--version'], capture_output=True,
+                              text=True).stdout.strip()
+    except OSError:
+        return ''
+
+
+def main():
+    p = optparse.OptionParser(usage='usage: %prog [options] [figures]')
+    p.add_option('-j', '--jobs', type='int', dest='jobs', default=os.cpu_count(),
+                 help='number of figures to make at once (default: number of CPUs)')
+    p.add_option('-f', '--force', action='store_true', dest='force', default=False,
+                 help='remake the figures even if they are up to date')
+    p.add_option('-l', '--list', action='store_true', dest='list', default=False,
+                 help='list the figures and their status, but do not make anything')
+    p.add_option('-n', '--dry-run', action='store_true', dest='dry_run', default=False,
+                 help='print what would be made, but do not make anything')
+    p.add_option('--root', type='string', dest='root', default='root', help='ROOT executable (default: root)')
+    (options, args) = p.parse_args()
+
+    by_name = {fig['name']: fig for fig in FIGURES}
+    for name in args:
+        if name not in by_name:
+            print('Unknown figure %s; use -l to see the list.' % name)
+            return 1
+
+    deps = find_dependencies(FIGURES)
+    # The figures requested, plus everything they depend on.
+    selected = set(args) if args else set(by_name)
+    todo = list(selected)
+    while todo:
+        for d in deps[todo.pop()]:
+            if d not in selected:
+                selected.add(d)
+                todo.append(d)
+
+    os.makedirs(log_dir, exist_ok=True)
+    cache = {}
+    if os.path.exists(cache_file):
+        with open(cache_file) as f:
+            cache = json.load(f)
+    cache.setdefault('files', {})
+    cache.setdefault('figures', {})
+    hasher = FileHasher(cache['files'])
+    root_version = get_root_version(options.root)
+
+    def status(fig):
+        _, missing = expand(fig, fig['inputs'])
+        if missing:
+            return 'missing input', missing
+        key = figure_key(fig, hasher, root_version)
+        if not options.force and cache['figures'].get(fig['name']) == key and outputs_exist(fig):
+            return 'up to date', key
+        return 'out of date', key
+
+    if options.list or options.dry_run:
+        for fig in FIGURES:
+            if fig['name'] not in selected:
+                continue
+            st, info = status(fig)
+            call = fig['macro'] + ('(%s)' % fig['args'] if fig['args'] else '')
+            print('%-12s %-14s %s/%s' % (fig['name'], st, fig['dir'], call))
+            if st == 'missing input':
+                print('%-27s %s' % ('', ', '.join(info)))
+        return 0
+
+    # Run everything, starting each figure once all the figures it depends on are done.
+    results = {}  # name -> (status, seconds)
+    waiting = [fig for fig in FIGURES if fig['name'] in selected]
+    running = {}
+    start = time.time()
+    with ThreadPoolExecutor(max_workers=max(1, options.jobs)) as pool:
+        while waiting or running:
+            for fig in list(waiting):
+                name = fig['name']
+                if any(d in selected and d not in results for d in deps[name]):
+                    continue
+                waiting.remove(fig)
+                if any(results[d][0] == 'FAILED' for d in deps[name] if d in results):
+                    results[name] = ('skipped', 0)
+                    continue
+                st, info = status(fig)
+                if st != 'out of date':
+                    results[name] = (st, 0)
+                    if st == 'missing input':
+                        print('%s: missing %s' % (name, ', '.join(info)))
+                    continue
+                print('Making %s (%s/%s)' % (name, fig['dir'], fig['macro']))
+                sys.stdout.flush()
+                running[pool.submit(run_figure, fig, options.root)] = (fig, info)
+            if not running:
+                if waiting:
+                    print('Circular dependency between %s' % ', '.join(fig['name'] for fig in waiting))
+                    return 1
+                break
+            done, _ = wait(list(running), return_when=FIRST_COMPLETED)
+            for future in done:
+                fig, key = running.pop(future)
+                ok, elapsed = future.result()
+                if ok:
+                    cache['figures'][fig['name']] = key
+                    results[fig['name']] = ('made', elapsed)
+                else:
+                    cache['figures'].pop(fig['name'], None)
+                    results[fig['name']] = ('FAILED', elapsed)
+                    print('%s FAILED, see %s' % (fig['name'], rel(os.path.join(log_dir, fig['name'] + '.log'))))
+                sys.stdout.flush()
+                # Save as we go, so that an interrupted run doesn't lose the figures already made.
+                with open(cache_file, 'w') as f:
+                    json.dump(cache, f, indent=1, sort_keys=True)
+    wall = time.time() - start
+
+    with open(cache_file, 'w') as f:
+        json.dump(cache, f, indent=1, sort_keys=True)
+
+    print()
+    print('%-12s %-14s %9s' % ('Figure', 'Status', 'Time (s)'))
+    total = 0
+    for fig in FIGURES:
+        if fig['name'] in results:
+            st, elapsed = results[fig['name']]
+            total += elapsed
+            print('%-12s %-14s %9.1f' % (fig['name'], st, elapsed))
+    print('Total time %.1f s, wall clock time %.1f s with %d processes' % (total, wall, max(1, options.jobs)))
+    return 1 if any(st == 'FAILED' for st, _ in results.values()) else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())